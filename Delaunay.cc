@@ -1,212 +1,507 @@
-// Robust version of Gilles Dumoulin's C++ port of Paul Bourke's
-// triangulation code available from
-// http://astronomy.swin.edu.au/~pbourke/papers/triangulate
-// Used with permission of Paul Bourke.
-// Segmentation fault and numerical robustness improvements by John C. Bowman
+// Incremental constrained Delaunay triangulation.
+//
+// The vertices are inserted in randomized rounds of roughly doubling size,
+// each sorted along a Hilbert curve.  Each vertex is located by walking
+// from the last triangle made; the triangles whose circumcircles contain it
+// are then replaced by a fan of triangles about it (Bowyer-Watson).  The
+// convex hull is closed by ghost triangles that share a vertex at
+// infinity, so no bounding triangle is needed.  Constrained edges are
+// recovered by flipping the edges that cross them (Sloan).  All decisions
+// use the exact orient2d and incircle predicates.
+
+#include <algorithm>
+#include <deque>
 
-#include <cassert>
 #include "Delaunay.h"
 #include "predicates.h"
+#include "camperror.h"
 
-inline double max(double a, double b)
-{
-  return (a > b) ? a : b;
-}
+namespace {
 
-int XYZCompare(const void *v1, const void *v2) 
-{
-  double x1=((XYZ*)v1)->p[0];
-  double x2=((XYZ*)v2)->p[0];
-  if(x1 < x2)
-    return(-1);
-  else if(x1 > x2)
-    return(1);
-  else
-    return(0);
-}
+// A triangle with vertices v[0], v[1], and v[2] in counterclockwise order
+// and neighbour n[k] across the edge opposite v[k], which is constrained
+// if c[k].  A ghost triangle has the vertex at infinity as v[2]; it lies
+// outside the convex hull edge from v[0] to v[1].
+struct triangle {
+  Int v[3];
+  Int n[3];
+  bool c[3];
+};
+
+// A directed edge.
+struct edge {
+  Int a,b;
+  edge(Int a, Int b) : a(a), b(b) {}
+};
 
-inline double hypot2(double *x)
+// An edge of a cavity, in counterclockwise order, and the triangle outside.
+struct boundary {
+  Int a,b;
+  Int outside;
+  bool c;
+};
+
+inline Int next(Int k) {return k == 2 ? 0 : k+1;}
+inline Int prev(Int k) {return k == 0 ? 2 : k-1;}
+
+inline int sign(double x) {return (x > 0) - (x < 0);}
+
+// Returns the distance of (x,y) along a Hilbert curve through a 2^16 by
+// 2^16 grid.
+unsigned long long hilbert(unsigned x, unsigned y)
 {
-  return x[0]*x[0]+x[1]*x[1];
+  const unsigned n=1u << 16;
+  unsigned long long d=0;
+  for(unsigned s=n/2; s > 0; s /= 2) {
+    unsigned rx=(x & s) > 0;
+    unsigned ry=(y & s) > 0;
+    d += (unsigned long long) s*s*((3*rx)^ry);
+    if(ry == 0) {
+      if(rx == 1) {
+        x=n-1-x;
+        y=n-1-y;
+      }
+      std::swap(x,y);
+    }
+  }
+  return d;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-// Triangulate():
-//   Triangulation subroutine
-//   Takes as input NV vertices in array pxyz
-//   Returned is a list of ntri triangular faces in the array v
-//   These triangles are arranged in a consistent clockwise order.
-//   The triangle array v should be allocated to 4 * nv
-//   The vertex array pxyz must be big enough to hold 3 additional points.
-//   By default, the array pxyz is automatically presorted and postsorted.
-///////////////////////////////////////////////////////////////////////////////
-
-Int Triangulate(Int nv, XYZ pxyz[], ITRIANGLE v[], Int &ntri,
-                bool presort, bool postsort)
-{
-  Int emax = 200;
-
-  if(presort) qsort(pxyz,nv,sizeof(XYZ),XYZCompare);
-  else postsort=false;
-  
-/* Allocate memory for the completeness list, flag for each triangle */
-  Int trimax = 4 * nv;
-  Int *complete = new Int[trimax];
-/* Allocate memory for the edge list */
-  IEDGE *edges = new IEDGE[emax];
-/*
-  Find the maximum and minimum vertex bounds.
-  This is to allow calculation of the bounding triangle
-*/
-  double xmin = pxyz[0].p[0];
-  double ymin = pxyz[0].p[1];
-  double xmax = xmin;
-  double ymax = ymin;
-  for(Int i = 1; i < nv; i++) {
-    XYZ *pxyzi=pxyz+i;
-    double x=pxyzi->p[0];
-    double y=pxyzi->p[1];
-    if (x < xmin) xmin = x;
-    if (x > xmax) xmax = x;
-    if (y < ymin) ymin = y;
-    if (y > ymax) ymax = y;
-  }
-  double dx = xmax - xmin;
-  double dy = ymax - ymin;
-/*
-  Set up the supertriangle.
-  This is a triangle which encompasses all the sample points.
-  The supertriangle coordinates are added to the end of the
-  vertex list. The supertriangle is the first triangle in
-  the triangle list.
-*/
-  static const double margin=0.01;
-  double xmargin=margin*dx;
-  double ymargin=margin*dy;
-  pxyz[nv+0].p[0] = xmin-xmargin;
-  pxyz[nv+0].p[1] = ymin-ymargin;
-  pxyz[nv+1].p[0] = xmin-xmargin;
-  pxyz[nv+1].p[1] = ymax+ymargin+dx;
-  pxyz[nv+2].p[0] = xmax+xmargin+dy;
-  pxyz[nv+2].p[1] = ymin-ymargin;
-  v->p1 = nv;
-  v->p2 = nv+1;
-  v->p3 = nv+2;
-  complete[0] = false;
-  ntri = 1;
-/*
-  Include each point one at a time into the existing mesh
-*/
-  for(Int i = 0; i < nv; i++) {
-    Int nedge = 0;
-    double *d=pxyz[i].p;
-/*
-  Set up the edge buffer.
-  If the point d lies inside the circumcircle then the
-  three edges of that triangle are added to the edge buffer
-  and that triangle is removed.
-*/
-    for(Int j = 0; j < ntri; j++) {
-      if(complete[j])
-        continue;
-      ITRIANGLE *vj=v+j;
-
-      double *a=pxyz[vj->p1].p;
-      double *b=pxyz[vj->p2].p;
-      double *c=pxyz[vj->p3].p;
-      
-      if(incircle(a,b,c,d) <= 0.0) { // Point d is inside or on circumcircle
-/* Check that we haven't exceeded the edge list size */
-        if(nedge + 3 >= emax) {
-          emax += 100;
-          IEDGE *p_EdgeTemp = new IEDGE[emax];
-          for (Int i = 0; i < nedge; i++) {
-            p_EdgeTemp[i] = edges[i];   
-          }
-          delete[] edges;
-          edges = p_EdgeTemp;
+class triangulation {
+  const XYZ *pxyz;
+  Int nv;                 // Also the vertex at infinity.
+  mem::vector<triangle> t;
+  mem::vector<Int> vt;    // A triangle containing each vertex, or -1.
+  mem::vector<Int> rep;   // The vertex used in place of each vertex.
+  Int last;               // The last triangle made.
+  unsigned long long seed;
+
+  // Work space for insert.
+  mem::vector<Int> visited;
+  Int stamp;
+  mem::vector<Int> cavity;
+  mem::vector<boundary> edges;
+  mem::vector<Int> startAt,endAt;
+
+  unsigned random() {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return (unsigned) seed;
+  }
+
+  const double *p(Int i) const {return pxyz[i].p;}
+
+  bool ghost(Int k) const {return t[k].v[2] == nv;}
+
+  static bool equal(const double *a, const double *b) {
+    return a[0] == b[0] && a[1] == b[1];
+  }
+
+  // Returns whether x, collinear with a and b, lies strictly between them.
+  static bool between(const double *a, const double *b, const double *x) {
+    int k=a[0] != b[0] ? 0 : 1;
+    return (a[k] < x[k] && x[k] < b[k]) || (b[k] < x[k] && x[k] < a[k]);
+  }
+
+  // Returns the index in triangle k of vertex a.
+  Int index(Int k, Int a) const {
+    const triangle& T=t[k];
+    return T.v[0] == a ? 0 : T.v[1] == a ? 1 : 2;
+  }
+
+  // Points the neighbour of triangle k across the edge from a to b to m.
+  void link(Int k, Int a, Int b, Int m) {
+    triangle& T=t[k];
+    for(Int i=0; i < 3; ++i)
+      if(T.v[i] != a && T.v[i] != b) {
+        T.n[i]=m;
+        return;
+      }
+  }
+
+  // Returns whether triangle k cannot remain with vertex x.
+  bool conflict(Int k, const double *x) const {
+    const triangle& T=t[k];
+    if(T.v[2] == nv) {
+      const double *a=p(T.v[0]), *b=p(T.v[1]);
+      double o=orient2d(a,b,x);
+      return o > 0 || (o == 0 && between(a,b,x));
+    }
+    return incircle(p(T.v[0]),p(T.v[1]),p(T.v[2]),x) > 0;
+  }
+
+  // Walks from triangle k to a triangle containing x, or to a ghost
+  // triangle outside a convex hull edge that x lies beyond.
+  Int locate(Int k, const double *x) {
+    if(ghost(k)) k=t[k].n[2];
+    for(;;) {
+      const triangle& T=t[k];
+      if(T.v[2] == nv) return k;
+      Int r=random() % 3;
+      Int i=0;
+      for(; i < 3; ++i) {
+        Int e=(i+r) % 3;
+        if(orient2d(p(T.v[next(e)]),p(T.v[prev(e)]),x) < 0) {
+          k=T.n[e];
+          break;
         }
-        ITRIANGLE *vj=v+j;
-        Int p1=vj->p1;
-        Int p2=vj->p2;
-        Int p3=vj->p3;
-        edges[nedge].p1 = p1;
-        edges[nedge].p2 = p2;
-        edges[++nedge].p1 = p2;
-        edges[nedge].p2 = p3;
-        edges[++nedge].p1 = p3;
-        edges[nedge].p2 = p1;
-        ++nedge;
-        ntri--;
-        v[j] = v[ntri];
-        complete[j] = complete[ntri];
-        j--;
-      } else {
-        double A=hypot2(a);
-        double B=hypot2(b);
-        double C=hypot2(c);
-        double a0=orient2d(a,b,c);
-        // Is d[0] > xc+r for circumcircle abc of radius r about (xc,yc)?
-        if(d[0]*a0 < 0.5*orient2d(A,a[1],B,b[1],C,c[1]))
-          complete[j]=
-            incircle(a[0]*a0,a[1]*a0,b[0]*a0,b[1]*a0,c[0]*a0,c[1]*a0,
-                     d[0]*a0,0.5*orient2d(a[0],A,b[0],B,c[0],C)) > 0.0;
+      }
+      if(i == 3) return k;
+    }
+  }
+
+  // Moves the vertex at infinity of triangle k, if any, to v[2].
+  void normalize(Int k) {
+    triangle& T=t[k];
+    while(T.v[0] == nv || T.v[1] == nv) {
+      triangle S=T;
+      for(Int i=0; i < 3; ++i) {
+        Int j=next(i);
+        T.v[i]=S.v[j];
+        T.n[i]=S.n[j];
+        T.c[i]=S.c[j];
+      }
+    }
+  }
+
+  void insert(Int i) {
+    const double *x=p(i);
+    Int k=locate(last,x);
+    if(!ghost(k)) {
+      const triangle& T=t[k];
+      for(Int j=0; j < 3; ++j)
+        if(equal(p(T.v[j]),x)) {
+          rep[i]=T.v[j];
+          return;
+        }
+    }
+
+    // Grow the cavity of triangles in conflict with x from triangle k.
+    ++stamp;
+    cavity.clear();
+    edges.clear();
+    cavity.push_back(k);
+    visited[k]=stamp;
+    for(size_t m=0; m < cavity.size(); ++m) {
+      const triangle& T=t[cavity[m]];
+      for(Int j=0; j < 3; ++j) {
+        Int l=T.n[j];
+        if(visited[l] == stamp) continue;
+        if(conflict(l,x)) {
+          visited[l]=stamp;
+          cavity.push_back(l);
+        } else {
+          boundary e={T.v[next(j)],T.v[prev(j)],l,T.c[j]};
+          edges.push_back(e);
+        }
+      }
+    }
+
+    // Join x to each edge of the cavity, reusing its triangles.
+    size_t ne=edges.size();
+    for(size_t m=cavity.size(); m < ne; ++m) {
+      cavity.push_back(t.size());
+      t.push_back(triangle());
+      visited.push_back(0);
+    }
+    for(size_t m=0; m < ne; ++m) {
+      Int c=cavity[m];
+      const boundary& e=edges[m];
+      triangle& T=t[c];
+      T.v[0]=e.a;
+      T.v[1]=e.b;
+      T.v[2]=i;
+      T.n[2]=e.outside;
+      T.c[0]=T.c[1]=false;
+      T.c[2]=e.c;
+      startAt[e.a]=c;
+      endAt[e.b]=c;
+      link(e.outside,e.a,e.b,c);
+    }
+    for(size_t m=0; m < ne; ++m) {
+      triangle& T=t[cavity[m]];
+      T.n[0]=startAt[T.v[1]];
+      T.n[1]=endAt[T.v[0]];
+    }
+    for(size_t m=0; m < ne; ++m) {
+      Int c=cavity[m];
+      normalize(c);
+      const triangle& T=t[c];
+      for(Int j=0; j < 3; ++j)
+        if(T.v[j] != nv) vt[T.v[j]]=c;
+      if(T.v[2] != nv) last=c;
+    }
+  }
+
+  // Finds the triangle k containing the edge from a to b in
+  // counterclockwise order and the index j in k of the opposite vertex.
+  bool find(Int a, Int b, Int& k, Int& j) const {
+    Int start=vt[a];
+    k=start;
+    do {
+      Int i=index(k,a);
+      if(t[k].v[next(i)] == b) {
+        j=prev(i);
+        return true;
+      }
+      k=t[k].n[next(i)];
+    } while(k != start);
+    return false;
+  }
+
+  // Flips the edge opposite vertex j of triangle k, returning the new edge.
+  edge flip(Int k, Int j) {
+    Int l=t[k].n[j];
+    const triangle A=t[k];
+    const triangle B=t[l];
+    // Replace (u,w,P) and (w,u,Q) with (u,Q,P) and (Q,w,P).
+    Int u=A.v[next(j)], w=A.v[prev(j)], P=A.v[j];
+    Int iu=index(l,u), iw=index(l,w);
+    Int Q=B.v[next(iu)];
+
+    triangle& C=t[k];
+    C.v[0]=u; C.v[1]=Q; C.v[2]=P;
+    C.n[0]=l; C.n[1]=A.n[prev(j)]; C.n[2]=B.n[iw];
+    C.c[0]=false; C.c[1]=A.c[prev(j)]; C.c[2]=B.c[iw];
+
+    triangle& D=t[l];
+    D.v[0]=Q; D.v[1]=w; D.v[2]=P;
+    D.n[0]=A.n[next(j)]; D.n[1]=k; D.n[2]=B.n[iu];
+    D.c[0]=A.c[next(j)]; D.c[1]=false; D.c[2]=B.c[iu];
+
+    link(t[k].n[2],u,Q,k);
+    link(t[l].n[0],w,P,l);
+    vt[u]=vt[Q]=vt[P]=k;
+    vt[w]=l;
+    last=k;
+    return edge(P,Q);
+  }
+
+  // Restores the Delaunay property, where constraints allow, by flipping
+  // the edges listed and then any edges made unsuitable by the flips.
+  void legalize(mem::vector<edge>& stack) {
+    while(!stack.empty()) {
+      edge e=stack.back();
+      stack.pop_back();
+      Int k,j;
+      if(!find(e.a,e.b,k,j) || t[k].c[j]) continue;
+      Int l=t[k].n[j];
+      if(ghost(k) || ghost(l)) continue;
+      const triangle& T=t[k];
+      Int q=t[l].v[next(index(l,e.a))];
+      if(incircle(p(T.v[0]),p(T.v[1]),p(T.v[2]),p(q)) > 0) {
+        Int P=T.v[j];
+        flip(k,j);
+        stack.push_back(edge(e.a,q));
+        stack.push_back(edge(q,e.b));
+        stack.push_back(edge(e.b,P));
+        stack.push_back(edge(P,e.a));
       }
     }
-/*
-  Tag multiple edges
-  Note: if all triangles are specified anticlockwise then all
-  interior edges are opposite pointing in direction.
-*/
-    for(Int j = 0; j < nedge - 1; j++) {
-      for(Int k = j + 1; k < nedge; k++) {
-        if((edges[j].p1 == edges[k].p2) && (edges[j].p2 == edges[k].p1)) {
-          edges[j].p1 = -1;
-          edges[j].p2 = -1;
-          edges[k].p1 = -1;
-          edges[k].p2 = -1;
+  }
+
+  void fix(Int a, Int b) {
+    Int k,j;
+    if(find(a,b,k,j)) t[k].c[j]=true;
+    if(find(b,a,k,j)) t[k].c[j]=true;
+  }
+
+  // Makes part of the edge from a to b a constrained edge of the
+  // triangulation, returning the vertex where that part ends: b, or the
+  // first vertex found to lie on the edge.
+  Int recover(Int a, Int b) {
+    for(;;) {
+      const double *A=p(a), *B=p(b);
+
+      // Find the triangle about a that the edge enters.
+      Int k=vt[a], start=k;
+      Int u,w;
+      for(;;) {
+        const triangle& T=t[k];
+        Int i=index(k,a);
+        u=T.v[next(i)];
+        w=T.v[prev(i)];
+        if(u == b || w == b) {
+          fix(a,b);
+          return b;
+        }
+        if(u != nv && orient2d(A,B,p(u)) == 0 && between(A,B,p(u))) {
+          fix(a,u);
+          return u;
         }
+        if(T.v[2] != nv && orient2d(A,B,p(u)) < 0 &&
+           orient2d(A,B,p(w)) > 0) break;
+        k=T.n[next(i)];
+        if(k == start)
+          camp::reportError("cannot constrain edge");
+      }
+
+      // List the edges that cross the edge from a to b.
+      std::deque<edge> crossed;
+      Int y;
+      for(;;) {
+        Int j=prev(index(k,u));
+        if(t[k].c[j])
+          camp::reportError("constrained edges intersect");
+        crossed.push_back(edge(u,w));
+        Int l=t[k].n[j];
+        y=t[l].v[next(index(l,u))];
+        if(y == b) break;
+        double o=orient2d(A,B,p(y));
+        if(o == 0) break;
+        if(o > 0) w=y;
+        else u=y;
+        k=l;
+      }
+      if(y != b) {
+        // First recover the edge to the vertex y that lies on it.
+        b=y;
+        continue;
       }
+
+      // Flip the crossing edges until none remain.
+      mem::vector<edge> made;
+      while(!crossed.empty()) {
+        edge e=crossed.front();
+        crossed.pop_front();
+        Int j=0;
+        find(e.a,e.b,k,j);
+        Int l=t[k].n[j];
+        const double *P=p(t[k].v[j]);
+        const double *Q=p(t[l].v[next(index(l,e.a))]);
+        if(sign(orient2d(P,Q,p(e.a)))*sign(orient2d(P,Q,p(e.b))) >= 0) {
+          // The quadrilateral is not strictly convex.
+          crossed.push_back(e);
+          continue;
+        }
+        edge f=flip(k,j);
+        int sp=sign(orient2d(A,B,p(f.a)));
+        int sq=sign(orient2d(A,B,p(f.b)));
+        if(sp*sq < 0)
+          crossed.push_back(sp < 0 ? f : edge(f.b,f.a));
+        else if(!((f.a == a && f.b == b) || (f.a == b && f.b == a)))
+          made.push_back(f);
+      }
+      fix(a,b);
+      legalize(made);
+      return b;
+    }
+  }
+
+  // Orders the vertices in randomized rounds of roughly doubling size,
+  // each sorted along a Hilbert curve.
+  void sort(mem::vector<Int>& order) {
+    double xmin=p(0)[0], xmax=xmin, ymin=p(0)[1], ymax=ymin;
+    for(Int i=1; i < nv; ++i) {
+      const double *x=p(i);
+      if(x[0] < xmin) xmin=x[0];
+      if(x[0] > xmax) xmax=x[0];
+      if(x[1] < ymin) ymin=x[1];
+      if(x[1] > ymax) ymax=x[1];
     }
-/*
-  Form new triangles for the current point
-  Skipping over any tagged edges.
-  All edges are arranged in clockwise order.
-*/
-    for(Int j = 0; j < nedge; j++) {
-      if(edges[j].p1 < 0 || edges[j].p2 < 0)
+    double sx=xmax > xmin ? 65535.0/(xmax-xmin) : 0.0;
+    double sy=ymax > ymin ? 65535.0/(ymax-ymin) : 0.0;
+
+    typedef std::pair<unsigned long long,Int> key;
+    mem::vector<key> keys(nv);
+    for(Int i=0; i < nv; ++i) {
+      unsigned r=0;
+      for(unsigned bits=random(); r < 31 && (bits & 1); bits >>= 1)
+        ++r;
+      const double *x=p(i);
+      unsigned long long h=hilbert((unsigned) ((x[0]-xmin)*sx),
+                                   (unsigned) ((x[1]-ymin)*sy));
+      keys[i]=key(((unsigned long long) (31-r) << 32) | h,i);
+    }
+    std::sort(keys.begin(),keys.end());
+    order.resize(nv);
+    for(Int i=0; i < nv; ++i)
+      order[i]=keys[i].second;
+  }
+
+public:
+  triangulation(Int nv, const XYZ pxyz[])
+    : pxyz(pxyz), nv(nv), vt(nv,-1), rep(nv), last(0),
+      seed(88172645463325252ULL), stamp(0), startAt(nv+1), endAt(nv+1) {
+    for(Int i=0; i < nv; ++i)
+      rep[i]=i;
+    if(nv < 3) return;
+
+    mem::vector<Int> order;
+    sort(order);
+
+    // Start with the first three vertices that are not collinear.
+    Int v[3]={order[0],-1,-1};
+    for(Int m=1; m < nv; ++m) {
+      const double *x=p(order[m]);
+      if(v[1] < 0) {
+        if(!equal(x,p(v[0]))) v[1]=order[m];
         continue;
-      v[ntri].p1 = edges[j].p1;
-      v[ntri].p2 = edges[j].p2;
-      v[ntri].p3 = i;
-      complete[ntri] = false;
-      ntri++;
-      assert(ntri < trimax);
+      }
+      double o=orient2d(p(v[0]),p(v[1]),x);
+      if(o != 0) {
+        v[2]=order[m];
+        if(o < 0) std::swap(v[1],v[2]);
+        break;
+      }
+    }
+    if(v[2] < 0) return;
+
+    // Ghost triangle 1+i lies outside the edge opposite v[i].
+    t.resize(4);
+    visited.assign(4,0);
+    for(Int i=0; i < 3; ++i) {
+      triangle& T=t[0];
+      T.v[i]=v[i];
+      T.n[i]=1+i;
+      T.c[i]=false;
+      vt[v[i]]=0;
+      triangle& G=t[1+i];
+      G.v[0]=v[prev(i)];
+      G.v[1]=v[next(i)];
+      G.v[2]=nv;
+      G.n[0]=1+prev(i);
+      G.n[1]=1+next(i);
+      G.n[2]=0;
+      G.c[0]=G.c[1]=G.c[2]=false;
+    }
+
+    for(Int m=0; m < nv; ++m) {
+      Int i=order[m];
+      if(i != v[0] && i != v[1] && i != v[2])
+        insert(i);
     }
   }
-/*
-  Remove triangles with supertriangle vertices
-  These are triangles which have a vertex number greater than nv
-*/
-  for(Int i = 0; i < ntri; i++) {
-    ITRIANGLE *vi=v+i;
-    if(vi->p1 >= nv || vi->p2 >= nv || vi->p3 >= nv) {
-      ntri--;
-      *vi = v[ntri];
-      i--;
+
+  void constrain(Int ne, const IEDGE edges[]) {
+    if(t.empty()) return;
+    for(Int i=0; i < ne; ++i) {
+      Int a=rep[edges[i].p1];
+      Int b=rep[edges[i].p2];
+      while(a != b)
+        a=recover(a,b);
     }
   }
-  delete[] edges;
-  delete[] complete;
 
-  if(postsort) { 
-    for(Int i = 0; i < ntri; i++) {
-      ITRIANGLE *vi=v+i;
-      vi->p1=pxyz[vi->p1].i;
-      vi->p2=pxyz[vi->p2].i;
-      vi->p3=pxyz[vi->p3].i;
+  // Lists the triangles in clockwise order.
+  void triangles(mem::vector<ITRIANGLE>& V) const {
+    V.clear();
+    for(size_t k=0; k < t.size(); ++k) {
+      const triangle& T=t[k];
+      if(T.v[2] == nv) continue;
+      ITRIANGLE tri={T.v[0],T.v[2],T.v[1]};
+      V.push_back(tri);
     }
   }
+};
+
+}
 
-  return 0;
-} 
+void Triangulate(Int nv, const XYZ pxyz[], mem::vector<ITRIANGLE>& v,
+                 Int ne, const IEDGE edges[])
+{
+  triangulation T(nv,pxyz);
+  T.constrain(ne,edges);
+  T.triangles(v);
+}
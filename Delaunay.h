@@ -21,9 +21,12 @@ struct XYZ{
   Int i;
 };
 
-Int Triangulate(Int nv, XYZ pxyz[], ITRIANGLE v[], Int &ntri,
-                bool presort=true, bool postsort=true);
+// Computes the Delaunay triangulation of the nv vertices in pxyz,
+// constrained to contain the ne edges between pairs of vertices, if any.
+// The triangles, which index pxyz, are arranged in a consistent clockwise
+// order.  Repeated vertices are used once; if all of the vertices are
+// collinear, there are no triangles.
+void Triangulate(Int nv, const XYZ pxyz[], mem::vector<ITRIANGLE>& v,
+                 Int ne=0, const IEDGE edges[]=NULL);
 
 #endif
-
-
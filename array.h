@@ -8,6 +8,11 @@
 #ifndef ARRAY_H
 #define ARRAY_H
 
+#include <cstddef>
+#if __cplusplus >= 201103L
+#include <type_traits>
+#endif
+
 #include "vm.h"
 #include "common.h"
 #include "item.h"
@@ -16,17 +21,116 @@ namespace vm {
 
 extern const char *dereferenceNullArray;
 
+// Whether items holding a value of type T never refer to collected memory.
+template<class T>
+struct pointerFreeItem { enum { value=false }; };
+template<>
+struct pointerFreeItem<double> { enum { value=true }; };
+template<>
+struct pointerFreeItem<bool> { enum { value=true }; };
+#if !NANBOX
+// (NaN-boxed Ints may be boxed.)
+template<>
+struct pointerFreeItem<Int> { enum { value=true }; };
+#endif
+
+// Whether an item holding a value of type T is just that value, so that
+// the items of an array of them are contiguous storage of type T.
+template<class T>
+struct typedItem { enum { value=false }; };
+#if COMPACT
+template<>
+struct typedItem<double> { enum { value=true }; };
+template<>
+struct typedItem<Int> { enum { value=true }; };
+#endif
+
+// The allocator for the items of an array.  The items of an array that only
+// holds values such as reals are allocated atomically, so that the garbage
+// collector neither scans them nor mistakes them for pointers.
+template<class T>
+class arrayAllocator {
+public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template<class U>
+  struct rebind { typedef arrayAllocator<U> other; };
+
+#if __cplusplus >= 201103L
+  // The storage of an array keeps its kind when moved or swapped.
+  typedef std::true_type propagate_on_container_copy_assignment;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+#endif
+
+  bool pointerFree;
+
+  arrayAllocator(bool pointerFree=false) : pointerFree(pointerFree) {}
+  template<class U>
+  arrayAllocator(const arrayAllocator<U>& a) : pointerFree(a.pointerFree) {}
+
+  T *allocate(size_t n, const void * =0) {
+#ifdef USEGC
+    return (T *) (pointerFree ? GC_MALLOC_ATOMIC(n*sizeof(T)) :
+                  GC_MALLOC(n*sizeof(T)));
+#else
+    return (T *) ::operator new(n*sizeof(T));
+#endif
+  }
+
+  void deallocate(T *p, size_t) {
+#ifdef USEGC
+    GC_FREE(p);
+#else
+    ::operator delete(p);
+#endif
+  }
+
+  T *address(T& x) const {return &x;}
+  const T *address(const T& x) const {return &x;}
+  size_t max_size() const {return size_t(-1)/sizeof(T);}
+  void construct(T *p, const T& x) {new(p) T(x);}
+  void destroy(T *p) {p->~T();}
+};
+
+// Storage of either kind can be released by either allocator.
+template<class T, class U>
+inline bool operator== (const arrayAllocator<T>&, const arrayAllocator<U>&)
+{
+  return true;
+}
+template<class T, class U>
+inline bool operator!= (const arrayAllocator<T>&, const arrayAllocator<U>&)
+{
+  return false;
+}
+
 // Arrays are vectors with push and pop functions.
-class array : public mem::vector<item> {
+class array : public std::vector<item, arrayAllocator<item> >, public gc {
+  typedef std::vector<item, arrayAllocator<item> > storage_t;
+
   bool cycle;  
 
-  void setNonBridgingSlice(size_t l, size_t r, mem::vector<item> *a);
-  void setBridgingSlice(size_t l, size_t r, mem::vector<item> *a);
+  void setNonBridgingSlice(size_t l, size_t r, const array *a);
+  void setBridgingSlice(size_t l, size_t r, const array *a);
 public:
   array() : cycle(false) {}
   
   array(size_t n)
-    : mem::vector<item>(n), cycle(false)
+    : storage_t(n), cycle(false)
+  {}
+
+  // An array whose items never refer to collected memory, such as one of
+  // reals, can be created pointer-free.  Copies and slices of it are also
+  // pointer-free.
+  array(size_t n, bool pointerFree)
+    : storage_t(n, item(), arrayAllocator<item>(pointerFree)), cycle(false)
   {}
 
   array(size_t n, item i, size_t depth);
@@ -60,6 +164,34 @@ public:
     return cycle;
   }
 
+  bool pointerFree() const {
+    return get_allocator().pointerFree;
+  }
+
+  // The items of an array of reals or Ints, as contiguous storage of that
+  // type, to be filled with values.
+  template<class T>
+  T *values() {
+#if __cplusplus >= 201103L
+    static_assert(typedItem<T>::value && sizeof(item) == sizeof(T),
+                  "items of this type are not stored as values");
+#endif
+    return size() == 0 ? NULL : reinterpret_cast<T *>(&(*this)[0]);
+  }
+
+  // The values held by the items of an array of reals or Ints, or NULL if
+  // an item is undefined.
+  template<class T>
+  const T *initializedValues() const {
+    size_t n=size();
+    if(n == 0) return NULL;
+    const item *p=&(*this)[0];
+    bool empty=false;
+    for(size_t i=0; i < n; ++i)
+      empty |= p[i].empty();
+    return empty ? NULL : const_cast<array *>(this)->values<T>();
+  }
+
   array *copyToDepth(size_t depth);
 };
 
@@ -24,6 +24,161 @@ using camp::tab;
 
 vm::array *copyArray(vm::array *a);
 vm::array *copyArray2(vm::array *a);
+
+// Kernels for element-wise operations on arrays.  Each returns false if it
+// does not apply, in which case the operation is done item by item.
+template<class T, class U, template <class S> class op>
+struct kernel {
+  static bool arrayOp(array *, const array *, U, size_t) {return false;}
+  static bool opArray(array *, T, const array *, size_t) {return false;}
+  static bool arrayArrayOp(array *, const array *, const array *, size_t) {
+    return false;
+  }
+};
+
+template<class T>
+struct sumKernel {
+  static bool sum(T&, const array *, size_t) {return false;}
+};
+
+template<class T, class S, T (*func)(S)>
+struct funcKernel {
+  static bool apply(array *, const array *, size_t) {return false;}
+};
+
+#if COMPACT
+// In the COMPACT representation an item holding a real is the double
+// itself.  Once an array of reals is known to be initialized, the kernels
+// below work on its values directly, in loops that the compiler can
+// vectorize; with OpenMP, large arrays are also split between threads.
+// Operations that could report an error are left to the item by item loops.
+
+// The array size from which a kernel is run in parallel.
+const size_t parallelSize=65536;
+
+// Sums of reals add fixed blocks of this many items in order, then add the
+// block sums in order, so the result does not depend on the threads used.
+const size_t sumBlock=4096;
+
+#ifdef _OPENMP
+#define PARALLEL_FOR _Pragma("omp parallel for if(n >= parallelSize)")
+#else
+#define PARALLEL_FOR
+#endif
+
+// Whether op<double> cannot fail, given y as its right operand.
+template <template <class S> class op>
+struct realOp {
+  static bool safe(double) {return false;}
+};
+
+#define SAFE_REAL_OP(op)                                        \
+  template<>                                                    \
+  struct realOp<op> {                                           \
+    static bool safe(double) {return true;}                     \
+  }
+
+SAFE_REAL_OP(plus);
+SAFE_REAL_OP(minus);
+SAFE_REAL_OP(times);
+SAFE_REAL_OP(less);
+SAFE_REAL_OP(lessequals);
+SAFE_REAL_OP(equals);
+SAFE_REAL_OP(greaterequals);
+SAFE_REAL_OP(greater);
+SAFE_REAL_OP(notequals);
+
+#undef SAFE_REAL_OP
+
+template<>
+struct realOp<divide> {
+  static bool safe(double y) {return y != 0;}
+};
+
+template <template <class S> class op>
+inline bool allSafe(const double *p, size_t n)
+{
+  bool unsafe=false;
+  for(size_t i=0; i < n; ++i)
+    unsafe |= !realOp<op>::safe(p[i]);
+  return !unsafe;
+}
+
+template<template <class S> class op>
+struct kernel<double,double,op> {
+  static bool arrayOp(array *c, const array *a, double b, size_t n) {
+    if(!realOp<op>::safe(b)) return false;
+    const double *A=a->initializedValues<double>();
+    if(!A) return false;
+    vm::item *C=&(*c)[0];
+    PARALLEL_FOR
+    for(size_t i=0; i < n; ++i)
+      C[i]=op<double>()(A[i],b,i);
+    return true;
+  }
+
+  static bool opArray(array *c, double b, const array *a, size_t n) {
+    const double *A=a->initializedValues<double>();
+    if(!A || !allSafe<op>(A,n)) return false;
+    vm::item *C=&(*c)[0];
+    PARALLEL_FOR
+    for(size_t i=0; i < n; ++i)
+      C[i]=op<double>()(b,A[i],i);
+    return true;
+  }
+
+  static bool arrayArrayOp(array *c, const array *a, const array *b,
+                           size_t n) {
+    const double *A=a->initializedValues<double>();
+    const double *B=b->initializedValues<double>();
+    if(!A || !B || !allSafe<op>(B,n)) return false;
+    vm::item *C=&(*c)[0];
+    PARALLEL_FOR
+    for(size_t i=0; i < n; ++i)
+      C[i]=op<double>()(A[i],B[i],i);
+    return true;
+  }
+};
+
+template<>
+struct sumKernel<double> {
+  static bool sum(double& sum, const array *a, size_t n) {
+    const double *A=a->initializedValues<double>();
+    if(!A) return false;
+    size_t blocks=(n+sumBlock-1)/sumBlock;
+    mem::vector<double> partial(blocks);
+    PARALLEL_FOR
+    for(size_t b=0; b < blocks; ++b) {
+      size_t end=std::min(n,(b+1)*sumBlock);
+      double total=0.0;
+      for(size_t i=b*sumBlock; i < end; ++i)
+        total += A[i];
+      partial[b]=total;
+    }
+    double total=0.0;
+    for(size_t b=0; b < blocks; ++b)
+      total += partial[b];
+    sum=total;
+    return true;
+  }
+};
+
+// The real functions mapped over arrays (sin, exp, etc.) cannot fail.
+template<double (*func)(double)>
+struct funcKernel<double,double,func> {
+  static bool apply(array *c, const array *a, size_t n) {
+    const double *A=a->initializedValues<double>();
+    if(!A) return false;
+    double *C=c->values<double>();
+    PARALLEL_FOR
+    for(size_t i=0; i < n; ++i)
+      C[i]=func(A[i]);
+    return true;
+  }
+};
+
+#undef PARALLEL_FOR
+#endif
   
 template<class T, class U, template <class S> class op>
 void arrayOp(vm::stack *s)
@@ -31,9 +186,10 @@ void arrayOp(vm::stack *s)
   U b=pop<U>(s);
   array *a=pop<array*>(s);
   size_t size=checkArray(a);
-  array *c=new array(size);
-  for(size_t i=0; i < size; i++)
-    (*c)[i]=op<T>()(read<T>(a,i),b,i);
+  array *c=new array(size,vm::pointerFreeItem<T>::value);
+  if(!kernel<T,U,op>::arrayOp(c,a,b,size))
+    for(size_t i=0; i < size; i++)
+      (*c)[i]=op<T>()(read<T>(a,i),b,i);
   s->push(c);
 }
 
@@ -43,9 +199,10 @@ void opArray(vm::stack *s)
   array *a=pop<array*>(s);
   T b=pop<T>(s);
   size_t size=checkArray(a);
-  array *c=new array(size);
-  for(size_t i=0; i < size; i++)
-    (*c)[i]=op<U>()(b,read<U>(a,i),i);
+  array *c=new array(size,vm::pointerFreeItem<U>::value);
+  if(!kernel<T,U,op>::opArray(c,b,a,size))
+    for(size_t i=0; i < size; i++)
+      (*c)[i]=op<U>()(b,read<U>(a,i),i);
   s->push(c);
 }
 
@@ -55,9 +212,10 @@ void arrayArrayOp(vm::stack *s)
   array *b=pop<array*>(s);
   array *a=pop<array*>(s);
   size_t size=checkArrays(a,b);
-  array *c=new array(size);
-  for(size_t i=0; i < size; i++)
-    (*c)[i]=op<T>()(read<T>(a,i),read<T>(b,i),i);
+  array *c=new array(size,vm::pointerFreeItem<T>::value);
+  if(!kernel<T,T,op>::arrayArrayOp(c,a,b,size))
+    for(size_t i=0; i < size; i++)
+      (*c)[i]=op<T>()(read<T>(a,i),read<T>(b,i),i);
   s->push(c);
 }
 
@@ -67,8 +225,9 @@ void sumArray(vm::stack *s)
   array *a=pop<array*>(s);
   size_t size=checkArray(a);
   T sum=0;
-  for(size_t i=0; i < size; i++)
-    sum += read<T>(a,i);
+  if(!sumKernel<T>::sum(sum,a,size))
+    for(size_t i=0; i < size; i++)
+      sum += read<T>(a,i);
   s->push(sum);
 }
 
@@ -147,7 +306,7 @@ void array2Op(vm::stack *s)
   for(size_t i=0; i < size; ++i) {
     array *ai=read<array*>(a,i);
     size_t aisize=checkArray(ai);
-    array *ci=new array(aisize);
+    array *ci=new array(aisize,vm::pointerFreeItem<T>::value);
     (*c)[i]=ci;
     for(size_t j=0; j < aisize; j++)
       (*ci)[j]=op<T>()(read<T>(ai,j),b,0);
@@ -165,7 +324,7 @@ void opArray2(vm::stack *s)
   for(size_t i=0; i < size; ++i) {
     array *ai=read<array*>(a,i);
     size_t aisize=checkArray(ai);
-    array *ci=new array(aisize);
+    array *ci=new array(aisize,vm::pointerFreeItem<U>::value);
     (*c)[i]=ci;
     for(size_t j=0; j < aisize; j++)
       (*ci)[j]=op<U>()(read<U>(ai,j),b,0);
@@ -184,7 +343,7 @@ void array2Array2Op(vm::stack *s)
     array *ai=read<array*>(a,i);
     array *bi=read<array*>(b,i);
     size_t aisize=checkArrays(ai,bi);
-    array *ci=new array(aisize);
+    array *ci=new array(aisize,vm::pointerFreeItem<T>::value);
     (*c)[i]=ci;
     for(size_t j=0; j < aisize; j++)
       (*ci)[j]=op<T>()(read<T>(ai,j),read<T>(bi,j),0);
@@ -233,7 +392,7 @@ void diagonal(vm::stack *s)
   size_t n=checkArray(a);
   array *c=new array(n);
   for(size_t i=0; i < n; ++i) {
-    array *ci=new array(n);
+    array *ci=new array(n,vm::pointerFreeItem<T>::value);
     (*c)[i]=ci;
     for(size_t j=0; j < i; ++j)
       (*ci)[j]=T();
@@ -481,9 +640,10 @@ void arrayFunc(vm::stack *s)
 {
   array *a=pop<array*>(s);
   size_t size=checkArray(a);
-  array *c=new array(size);
-  for(size_t i=0; i < size; i++)
-    (*c)[i]=func(read<S>(a,i));
+  array *c=new array(size,vm::pointerFreeItem<T>::value);
+  if(!funcKernel<T,S,func>::apply(c,a,size))
+    for(size_t i=0; i < size; i++)
+      (*c)[i]=func(read<S>(a,i));
   s->push(c);
 }
 
@@ -496,7 +656,7 @@ void arrayFunc2(vm::stack *s)
   for(size_t i=0; i < size; ++i) {
     array *ai=read<array*>(a,i);
     size_t aisize=checkArray(ai);
-    array *ci=new array(aisize);
+    array *ci=new array(aisize,vm::pointerFreeItem<T>::value);
     (*c)[i]=ci;
     for(size_t j=0; j < aisize; j++)
     (*ci)[j]=func(read<S>(ai,j));
@@ -520,14 +680,40 @@ inline size_t checkdimension(const vm::array *a, size_t dim)
   return size;
 }
 
+// Copies between C arrays and arrays whose items hold values of type T.
+// When those items are stored as the values themselves, an array is copied
+// as a whole; otherwise, or if an item is undefined, it is copied item by
+// item.
+template<class T, bool typed=vm::typedItem<T>::value>
+struct valueCopy {
+  static void toC(T *dest, const vm::array *a, size_t n) {
+    for(size_t i=0; i < n; i++) 
+      dest[i]=vm::read<T>(a,i);
+  }
+  static void fromC(vm::array *a, const T *p, size_t n) {
+    for(size_t i=0; i < n; ++i) (*a)[i]=p[i];
+  }
+};
+
+template<class T>
+struct valueCopy<T,true> {
+  static void toC(T *dest, const vm::array *a, size_t n) {
+    const T *A=a->initializedValues<T>();
+    if(A) std::copy(A,A+n,dest);
+    else valueCopy<T,false>::toC(dest,a,n);
+  }
+  static void fromC(vm::array *a, const T *p, size_t n) {
+    std::copy(p,p+n,a->values<T>());
+  }
+};
+
 template<class T>
 inline void copyArrayC(T* &dest, const vm::array *a, size_t dim=0,
                        GCPlacement placement=NoGC)
 {
   size_t size=checkdimension(a,dim);
   dest=(placement == NoGC) ? new T[size] : new(placement) T[size];
-  for(size_t i=0; i < size; i++) 
-    dest[i]=vm::read<T>(a,i);
+  valueCopy<T>::toC(dest,a,size);
 }
 
 template<class T, class A>
@@ -543,8 +729,8 @@ inline void copyArrayC(T* &dest, const vm::array *a, T (*cast)(A),
 template<typename T>
 inline vm::array* copyCArray(const size_t n, const T* p)
 {
-  vm::array* a = new vm::array(n);
-  for(size_t i=0; i < n; ++i) (*a)[i] = p[i];
+  vm::array* a = new vm::array(n,vm::pointerFreeItem<T>::value);
+  valueCopy<T>::fromC(a,p,n);
   return a;
 }
 
@@ -564,11 +750,9 @@ inline void copyArray2C(T* &dest, const vm::array *a, bool square=true,
   for(size_t i=0; i < n; i++) {
     vm::array *ai=vm::read<vm::array*>(a,i);
     size_t aisize=checkArray(ai);
-    if(aisize == m) {
-      T *desti=dest+i*m;
-      for(size_t j=0; j < m; j++) 
-        desti[j]=vm::read<T>(ai,j);
-    } else
+    if(aisize == m)
+      valueCopy<T>::toC(dest+i*m,ai,m);
+    else
       vm::error(square ? "matrix must be square" : 
                 "matrix must be rectangular");
   }
@@ -579,10 +763,9 @@ inline vm::array* copyCArray2(const size_t n, const size_t m, const T* p)
 {
   vm::array* a=new vm::array(n);
   for(size_t i=0; i < n; ++i) {
-    array *ai=new array(m);
+    array *ai=new array(m,vm::pointerFreeItem<T>::value);
     (*a)[i]=ai;
-    for(size_t j=0; j < m; ++j) 
-      (*ai)[j]=p[m*i+j];
+    valueCopy<T>::fromC(ai,p+m*i,m);
   }
   return a;
 }
@@ -0,0 +1,170 @@
+/*****
+ * bvh.h
+ *
+ * A bounding volume hierarchy of axis-aligned boxes, for finding the pairs
+ * of items whose boxes overlap.
+ *****/
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <algorithm>
+
+#include "common.h"
+
+namespace camp {
+
+// A box in D dimensions.
+template<size_t D>
+struct bvhbox {
+  double min[D],max[D];
+
+  bool overlaps(const bvhbox& b) const {
+    for(size_t k=0; k < D; ++k)
+      if(max[k] < b.min[k] || b.max[k] < min[k]) return false;
+    return true;
+  }
+
+  void add(const bvhbox& b) {
+    for(size_t k=0; k < D; ++k) {
+      if(b.min[k] < min[k]) min[k]=b.min[k];
+      if(b.max[k] > max[k]) max[k]=b.max[k];
+    }
+  }
+};
+
+// A binary tree over the boxes of a number of items, split at the median
+// center along the longest side of each node.
+template<size_t D>
+class bvh {
+  typedef bvhbox<D> box;
+
+  struct node {
+    box b;
+    size_t first,count; // Items order[first...first+count-1], if a leaf.
+    size_t left,right;
+  };
+
+  const mem::vector<box>& boxes;
+  mem::vector<size_t> order;
+  mem::vector<node> nodes;
+
+  static const size_t leafsize=4;
+
+  struct center {
+    const mem::vector<box>& boxes;
+    size_t k;
+    center(const mem::vector<box>& boxes, size_t k) : boxes(boxes), k(k) {}
+    bool operator()(size_t i, size_t j) const {
+      return boxes[i].min[k]+boxes[i].max[k] <
+        boxes[j].min[k]+boxes[j].max[k];
+    }
+  };
+
+  size_t build(size_t first, size_t count) {
+    size_t n=nodes.size();
+    nodes.push_back(node());
+    box b=boxes[order[first]];
+    for(size_t i=1; i < count; ++i)
+      b.add(boxes[order[first+i]]);
+    nodes[n].b=b;
+
+    if(count <= leafsize) {
+      nodes[n].first=first;
+      nodes[n].count=count;
+      return n;
+    }
+
+    size_t axis=0;
+    for(size_t k=1; k < D; ++k)
+      if(b.max[k]-b.min[k] > b.max[axis]-b.min[axis]) axis=k;
+    size_t half=count/2;
+    mem::vector<size_t>::iterator p=order.begin()+first;
+    std::nth_element(p,p+half,p+count,center(boxes,axis));
+
+    nodes[n].count=0;
+    size_t left=build(first,half);
+    size_t right=build(first+half,count-half);
+    nodes[n].left=left;
+    nodes[n].right=right;
+    return n;
+  }
+
+  template<class F>
+  void self(size_t a, F& f) const {
+    const node& A=nodes[a];
+    if(A.count) {
+      for(size_t i=0; i < A.count; ++i) {
+        size_t I=order[A.first+i];
+        for(size_t j=i+1; j < A.count; ++j) {
+          size_t J=order[A.first+j];
+          if(boxes[I].overlaps(boxes[J])) f(I,J);
+        }
+      }
+      return;
+    }
+    self(A.left,f);
+    self(A.right,f);
+    crossTrees(A.left,*this,A.right,f);
+  }
+
+  static double size(const node& a) {
+    double s=0.0;
+    for(size_t k=0; k < D; ++k)
+      s += a.b.max[k]-a.b.min[k];
+    return s;
+  }
+
+public:
+  // The boxes must outlive the tree.
+  bvh(const mem::vector<box>& boxes) : boxes(boxes), order(boxes.size()) {
+    size_t n=boxes.size();
+    for(size_t i=0; i < n; ++i)
+      order[i]=i;
+    if(n > 0) {
+      nodes.reserve(2*n/leafsize+1);
+      build(0,n);
+    }
+  }
+
+  // Calls f(i,j) once for each pair of distinct items whose boxes overlap.
+  template<class F>
+  void pairs(F& f) const {
+    if(!nodes.empty()) self(0,f);
+  }
+
+  // Calls f(i,j) for each item i of this tree and item j of tree t whose
+  // boxes overlap.
+  template<class F>
+  void pairs(const bvh& t, F& f) const {
+    if(!nodes.empty() && !t.nodes.empty())
+      crossTrees(0,t,0,f);
+  }
+
+private:
+  template<class F>
+  void crossTrees(size_t a, const bvh& t, size_t b, F& f) const {
+    const node& A=nodes[a];
+    const node& B=t.nodes[b];
+    if(!A.b.overlaps(B.b)) return;
+    if(A.count && B.count) {
+      for(size_t i=0; i < A.count; ++i) {
+        size_t I=order[A.first+i];
+        for(size_t j=0; j < B.count; ++j) {
+          size_t J=t.order[B.first+j];
+          if(boxes[I].overlaps(t.boxes[J])) f(I,J);
+        }
+      }
+    } else if(B.count || (!A.count && size(A) >= size(B))) {
+      crossTrees(A.left,t,b,f);
+      crossTrees(A.right,t,b,f);
+    } else {
+      crossTrees(a,t,B.left,f);
+      crossTrees(a,t,B.right,f);
+    }
+  }
+};
+
+}
+
+#endif
@@ -14,12 +14,15 @@
 #include "genv.h"
 #include "entry.h"
 #include "builtin.h"
+#include "settings.h"
 
 using namespace sym;
 using namespace types;
 
 namespace trans {
 
+codeStats translatedCode = { 0, 0, 0 };
+
 namespace {
 function *inittype();
 function *bootuptype();
@@ -334,6 +337,13 @@ vm::lambda *coder::close() {
   if (funtype->result->kind == types::ty_void)
     encode(inst::ret);
 
+  if (settings::optimize)
+    program->optimize();
+
+  translatedCode.instructions += program->size();
+  translatedCode.codeBytes += program->codeBytes();
+  translatedCode.posBytes += program->posBytes();
+
   l->code = program;
 
   l->parentIndex = level->parentIndex();
@@ -56,6 +56,15 @@ struct label_t : public gc {
 };
 typedef label_t *label;
 
+// The size of the code of all functions translated so far, for reporting
+// memory use.
+struct codeStats {
+  size_t instructions;
+  size_t codeBytes;
+  size_t posBytes;
+};
+extern codeStats translatedCode;
+
 class coder {
   // The frame of the function we are currently encoding.  This keeps
   // track of local variables, and parameters with respect to the stack.
@@ -265,15 +274,20 @@ public:
 private:
   void encode(inst i)
   {
-    i.pos = curPos;
+    encode(i, curPos);
+  }
+
+  // Encode an instruction that comes from the source at pos.
+  void encode(inst i, position pos)
+  {
     // Static code is put into the enclosing coder, unless we are translating a
     // codelet.
     if (isStatic() && !isTopLevel()) {
       assert(parent);
-      parent->encode(i);
+      parent->encode(i, pos);
     }
     else {
-      program->encode(i);
+      program->encode(i, pos);
     }
   }
 
@@ -283,7 +297,7 @@ private:
 public:
   void encode(inst::opcode op)
   {
-    inst i; i.op = op; i.pos = nullPos;
+    inst i; i.op = op;
     encode(i);
   }
   void encode(inst::opcode op, item it)
@@ -291,7 +305,7 @@ public:
 #ifdef DEBUG_BLTIN
     assertBltinLookup(op, it);
 #endif
-    inst i; i.op = op; i.pos = nullPos; i.ref = it;
+    inst i; i.op = op; i.ref = it;
     encode(i);
   }
 
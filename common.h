@@ -60,6 +60,11 @@ typedef unsigned int unsignedInt;
 #endif
 #endif
 
+// Items are NaN-boxed (see item.h) only if they cannot be COMPACT.
+#if COMPACT
+#undef NANBOX
+#endif
+
 #if COMPACT
 // Reserve highest two values for DefaultValue and Undefined states.
 #define Int_MAX (Int_MAX2-2)
@@ -821,6 +821,7 @@ void includedec::loadFailed(coenv &)
 void includedec::transAsField(coenv &e, record *r)
 {
   file *ast = parser::parseFile(filename,"Including");
+  e.e.addInclude(filename);
   em.sync();
 
   // The runnables will be translated, one at a time, without any additional
@@ -46,6 +46,8 @@ public:
   
   bool svg() {return true;}
   
+  bool nativepdf() {return !stroke;}
+  
   void save(bool b) {
     gsave=b;
   }
@@ -211,6 +211,9 @@ public:
 // Implement SVG element as png image?
   virtual bool svgpng() {return false;}
   
+// Can the element be written directly to PDF, without PostScript?
+  virtual bool nativepdf() {return true;}
+  
   virtual bool beginclip() {return false;}
   virtual bool endclip() {return false;}
   
@@ -32,6 +32,9 @@ public:
   // dvisvgm doesn't yet support SVG patterns.
   bool svgpng() {return pentype.fillpattern() != "";}
   
+  // PDF has no strokepath operator.
+  bool nativepdf() {return !stroke && pentype.fillpattern().empty();}
+  
   virtual ~drawFill() {}
 
   virtual bool draw(psfile *out);
@@ -8,6 +8,9 @@
 #include <sstream>
 
 #include "drawlabel.h"
+#include "labelcache.h"
+#include "fragment.h"
+#include "pdffile.h"
 #include "settings.h"
 #include "util.h"
 #include "lexical.h"
@@ -24,66 +27,220 @@ void drawLabel::labelwarning(const char *action)
        << "\" " << action << " to avoid overwriting" << endl;
 }
  
-// Reads one of the dimensions from the pipe.
-void texdim(iopipestream& tex, double& dest, const string command,
-            const string name)
+namespace {
+// TeX reports the dimensions of \ASYbox on one line, tagged with the index
+// of the label in its batch, as
+//   >dim<index>(<width>pt)(<height>pt)(<depth>pt)dim
+const string dimstart=">dim";
+const string dimopen="(";
+const string dimsep="pt)(";
+const string dimstop="pt)dim";
+const string dimexpect=dimstop+"\n\n*";
+
+void setbox(iopipestream& tex, string& s)
 {
-  string start(">dim(");
-  string stop(")dim");
-  string expect("pt"+stop+"\n\n*");
-
-  // ask the tex engine for dimension
-  tex << "\\immediate\\write16{" << start << "\\the\\" << command << "\\ASYbox"
-      << stop << "}\n";
-  // keep reading output until ')dim\n\n*' is read
-  tex.wait(expect.c_str());
-  string buffer = tex.getbuffer();
-
-  size_t dim1=buffer.find(start);
-  size_t dim2=buffer.find("pt" + stop);
-  string cannotread="Cannot read label "+name;
-  if (dim1 != string::npos && dim2 != string::npos) {
-    string n=buffer.substr(dim1+start.size(),dim2-dim1-start.size());
-    try {
-      dest=lexical::cast<double>(n,true)*tex2ps;
-    } catch(lexical::bad_cast&) {
-      camp::reportError(cannotread);
-    }
-  } else {
-    camp::reportError(cannotread);
+  tex << "\\setbox\\ASYbox=\\hbox{" << stripblanklines(s) << "}\n\n";
+}
+
+// Asks the tex engine for the dimensions of the box.
+void querydims(iopipestream& tex, size_t index=0)
+{
+  tex << "\\immediate\\write16{" << dimstart << index << dimopen
+      << "\\the\\wd\\ASYbox" << dimsep << "\\the\\ht\\ASYbox" << dimsep
+      << "\\the\\dp\\ASYbox" << dimstop << "}\n";
+}
+
+// Reads the first dimensions reported in buffer after pos, and their index,
+// advancing pos past them.  Returns false if the report is not yet complete.
+bool readdims(const string& buffer, size_t& pos, labeldims& d, size_t& index)
+{
+  size_t start=buffer.find(dimstart,pos);
+  if(start == string::npos) return false;
+  size_t stop=buffer.find(dimstop,start);
+  if(stop == string::npos) return false;
+  pos=stop+dimstop.size();
+
+  start += dimstart.size();
+  size_t open=buffer.find(dimopen,start);
+  size_t sep1=open < stop ? buffer.find(dimsep,open) : string::npos;
+  size_t sep2=sep1 < stop ? buffer.find(dimsep,sep1+dimsep.size()) :
+    string::npos;
+  if(sep2 >= stop)
+    camp::reportError("Cannot read label dimensions");
+
+  try {
+    index=lexical::cast<size_t>(buffer.substr(start,open-start));
+    open += dimopen.size();
+    d.width=lexical::cast<double>(buffer.substr(open,sep1-open),true)*tex2ps;
+    sep1 += dimsep.size();
+    d.height=lexical::cast<double>(buffer.substr(sep1,sep2-sep1),true)*tex2ps;
+    sep2 += dimsep.size();
+    d.depth=lexical::cast<double>(buffer.substr(sep2,stop-sep2),true)*tex2ps;
+  } catch(lexical::bad_cast&) {
+    camp::reportError("Cannot read label dimensions");
   }
+  return true;
+}
 }
 
 void texbounds(double& width, double& height, double& depth,
                iopipestream& tex, string& s)
 {
-  tex << "\\setbox\\ASYbox=\\hbox{" << stripblanklines(s) << "}\n\n";
+  setbox(tex,s);
   tex.wait(texready.c_str());
-  texdim(tex,width,"wd","width");
-  texdim(tex,height,"ht","height");
-  texdim(tex,depth,"dp","depth");
+  querydims(tex);
+  // keep reading output until 'pt)dim\n\n*' is read
+  tex.wait(dimexpect.c_str());
+
+  size_t pos=0,index;
+  labeldims d;
+  if(!readdims(tex.getbuffer(),pos,d,index))
+    camp::reportError("Cannot read label dimensions");
+  width=d.width;
+  height=d.height;
+  depth=d.depth;
 }   
 
+void texbounds(double& width, double& height, double& depth,
+               iopipestream& tex, const string& texengine, const pen& pentype,
+               string& s)
+{
+  uint64_t key=labelCache.key(texengine,pentype,s);
+  labeldims d;
+  if(!labelCache.find(key,d)) {
+    setpen(tex,texengine,pentype);
+    texbounds(d.width,d.height,d.depth,tex,s);
+    labelCache.store(key,d);
+  }
+  width=d.width;
+  height=d.height;
+  depth=d.depth;
+}
+
+void texbounds(iopipestream& tex, const string& texengine,
+               mem::vector<labelquery>& queries)
+{
+  // Labels are sent in groups, so that the replies of TeX never fill the
+  // pipe while it waits for us to read them.
+  static const size_t groupsize=32;
+
+  size_t n=queries.size();
+  mem::vector<uint64_t> keys(n);
+  mem::vector<size_t> pending;
+  for(size_t i=0; i < n; ++i) {
+    labelquery& q=queries[i];
+    keys[i]=labelCache.key(texengine,*q.pentype,*q.s);
+    if(!labelCache.find(keys[i],q.dims))
+      pending.push_back(i);
+  }
+
+  size_t m=pending.size();
+  if(m == 0) return;
+
+  // When there are enough labels, they are shared, in contiguous runs, among
+  // the pool of TeX processes, which then work concurrently.
+  texpool& pool=processData().texworkers;
+  size_t npipes=min(pool.size(),(m+groupsize-1)/groupsize);
+  mem::vector<iopipestream *> pipes(npipes);
+  mem::vector<pen *> lastpens(npipes);
+  pipes[0]=&tex;
+  lastpens[0]=&drawElement::lastpen;
+  for(size_t k=1; k < npipes; ++k) {
+    texpool::worker *w=pool.get(k);
+    pipes[k]=&w->tex;
+    lastpens[k]=&w->lastpen;
+  }
+
+  mem::vector<size_t> next(npipes), end(npipes), last(npipes);
+  for(size_t k=0; k < npipes; ++k) {
+    next[k]=k*m/npipes;
+    end[k]=(k+1)*m/npipes;
+  }
+
+  for(;;) {
+    bool done=true;
+    for(size_t k=0; k < npipes; ++k) {
+      last[k]=min(next[k]+groupsize,end[k]);
+      for(size_t j=next[k]; j < last[k]; ++j) {
+        labelquery& q=queries[pending[j]];
+        setpen(*pipes[k],texengine,*q.pentype,*lastpens[k],false);
+        setbox(*pipes[k],*q.s);
+        querydims(*pipes[k],j);
+        done=false;
+      }
+    }
+    if(done) break;
+
+    for(size_t k=0; k < npipes; ++k) {
+      string buffer;
+      size_t pos=0;
+      labeldims d;
+      size_t index;
+      for(size_t j=next[k]; j < last[k];) {
+        if(!readdims(buffer,pos,d,index)) {
+          pipes[k]->wait(dimexpect.c_str());
+          buffer.append(pipes[k]->getbuffer());
+        } else if(index == j)
+          queries[pending[j++]].dims=d;
+        else {
+          // A reply is missing or extra, so a label of this group upset
+          // TeX.  Wait for the last reply of the group, then measure the
+          // rest of the group one label at a time.
+          size_t bad=index > j ? j : j-1;
+          labelquery& b=queries[pending[bad]];
+          reportWarning("TeX did not measure the label \""+*b.s+
+                        "\" as expected; measuring labels one at a time");
+          while(index != last[k]-1) {
+            if(!readdims(buffer,pos,d,index)) {
+              pipes[k]->wait(dimexpect.c_str());
+              buffer.append(pipes[k]->getbuffer());
+            }
+          }
+          for(j=bad; j < last[k]; ++j) {
+            labelquery& q=queries[pending[j]];
+            setpen(*pipes[k],texengine,*q.pentype,*lastpens[k],true);
+            texbounds(q.dims.width,q.dims.height,q.dims.depth,*pipes[k],
+                      *q.s);
+          }
+        }
+      }
+      next[k]=last[k];
+    }
+  }
+
+  // The results are recorded in order, independently of how they were
+  // shared.
+  for(size_t j=0; j < m; ++j)
+    labelCache.store(keys[pending[j]],queries[pending[j]].dims);
+}
+
 inline double urand()
 {                         
   static const double factor=2.0/RANDOM_MAX;
   return random()*factor-1.0;
 }
 
-void setpen(iopipestream& tex, const string& texengine, const pen& pentype) 
+void setpen(iopipestream& tex, const string& texengine, const pen& pentype,
+            pen& lastpen, bool wait) 
 {
   bool Latex=latex(texengine);
   
-  if(Latex && setlatexfont(tex,pentype,drawElement::lastpen)) {
+  if(Latex && setlatexfont(tex,pentype,lastpen)) {
     tex << "\n";
-    tex.wait(texready.c_str());
+    if(wait) tex.wait(texready.c_str());
   }
-  if(settexfont(tex,pentype,drawElement::lastpen,Latex)) {
+  if(settexfont(tex,pentype,lastpen,Latex)) {
     tex << "\n";
-    tex.wait(texready.c_str());
+    if(wait) tex.wait(texready.c_str());
   }
   
-  drawElement::lastpen=pentype;
+  lastpen=pentype;
+}
+
+void setpen(iopipestream& tex, const string& texengine, const pen& pentype,
+            bool wait) 
+{
+  setpen(tex,texengine,pentype,drawElement::lastpen,wait);
 }
 
 void drawLabel::getbounds(iopipestream& tex, const string& texengine)
@@ -91,11 +248,12 @@ void drawLabel::getbounds(iopipestream& tex, const string& texengine)
   if(havebounds) return;
   havebounds=true;
   
-  setpen(tex,texengine,pentype);
-  texbounds(width,height,depth,tex,label);
+  if(!havedims) {
+    texbounds(width,height,depth,tex,texengine,pentype,label);
   
-  if(width == 0.0 && height == 0.0 && depth == 0.0 && !size.empty())
-    texbounds(width,height,depth,tex,size);
+    if(width == 0.0 && height == 0.0 && depth == 0.0 && !size.empty())
+      texbounds(width,height,depth,tex,texengine,pentype,size);
+  }
 
   enabled=true;
     
@@ -113,6 +271,43 @@ void drawLabel::getbounds(iopipestream& tex, const string& texengine)
   Align=T*Align;
 }
 
+void drawLabel::measure(iopipestream& tex, const string& texengine,
+                        mem::list<drawElement *>::iterator p,
+                        mem::list<drawElement *>::iterator end)
+{
+  mem::vector<drawLabel *> labels;
+  mem::vector<labelquery> queries;
+  for(; p != end; ++p) {
+    drawLabel *L=dynamic_cast<drawLabel *>(*p);
+    if(!L) {
+      // Other TeX code may change how the labels that follow are typeset.
+      if((*p)->islabel()) break;
+      continue;
+    }
+    if(L->havebounds || L->havedims) continue;
+    labels.push_back(L);
+    queries.push_back(labelquery(&L->pentype,&L->label));
+  }
+  texbounds(tex,texengine,queries);
+
+  // Empty labels are measured by their size string instead.
+  mem::vector<drawLabel *> sized;
+  mem::vector<labelquery> sizes;
+  for(size_t i=0; i < labels.size(); ++i) {
+    drawLabel *L=labels[i];
+    labeldims& d=queries[i].dims;
+    if(d.width == 0.0 && d.height == 0.0 && d.depth == 0.0 &&
+       !L->size.empty()) {
+      sized.push_back(L);
+      sizes.push_back(labelquery(&L->pentype,&L->size));
+    } else
+      L->setdims(d);
+  }
+  texbounds(tex,texengine,sizes);
+  for(size_t i=0; i < sized.size(); ++i)
+    sized[i]->setdims(sizes[i].dims);
+}
+
 void drawLabel::bounds(bbox& b, iopipestream& tex, boxvector& labelbounds,
                        bboxlist&)
 {
@@ -193,6 +388,33 @@ bool drawLabel::write(texfile *out, const bbox&)
   return true;
 }
 
+uint64_t drawLabel::fragmentkey()
+{
+  return fragmentcache::key(pentype,label);
+}
+
+void drawLabel::writefragment(texfile *out)
+{
+  out->beginfragment();
+  out->setpen(pentype);
+  out->endfragment(label);
+}
+
+void drawLabel::place(pdffile *out)
+{
+  checkbounds();
+  if(!visible()) return;
+  const labelfragment *f=fragmentCache.find(fragmentkey());
+  if(!f)
+    reportError("label \""+label+"\" was not typeset");
+
+  // As in \ASYaligned, the baseline starts at texAlign, in units of the
+  // width and the total height of the box, from the position.
+  pair offset=pair(texAlign.getx()*f->width,
+                   texAlign.gety()*f->height-f->depth)-f->origin;
+  out->place(f->doc,f->page,shift(position)*T*shift(offset));
+}
+
 drawElement *drawLabel::transformed(const transform& t)
 {
   return new drawLabel(label,size,t*T,t*position,
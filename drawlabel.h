@@ -12,9 +12,21 @@
 #include "path.h"
 #include "angle.h"
 #include "transform.h"
+#include "labelcache.h"
 
 namespace camp {
+
+class pdffile;
   
+// A label string, typeset in a pen, whose dimensions are to be found.
+struct labelquery {
+  const pen *pentype;
+  string *s;
+  labeldims dims;
+
+  labelquery(const pen *pentype, string *s) : pentype(pentype), s(s) {}
+};
+
 class drawLabel : public virtual drawElement {
 protected:
   string label,size;
@@ -24,6 +36,7 @@ protected:
   pair scale;
   pen pentype;
   double width,height,depth;
+  bool havedims;
   bool havebounds;
   bool suppress;
   pair Align;
@@ -36,12 +49,26 @@ public:
             pair align, pen pentype, const string& key="")
     : drawElement(key), label(label), size(size), T(shiftless(T)),
       position(position), align(align), pentype(pentype), width(0.0),
-      height(0.0), depth(0.0), havebounds(false), suppress(false),
+      height(0.0), depth(0.0), havedims(false), havebounds(false),
+      suppress(false),
       enabled(false) {} 
   
   virtual ~drawLabel() {}
 
+  void setdims(const labeldims& d) {
+    width=d.width;
+    height=d.height;
+    depth=d.depth;
+    havedims=true;
+  }
+
   void getbounds(iopipestream& tex, const string& texengine);
+
+  // Finds the dimensions of the unmeasured labels among the nodes from p to
+  // end at once, up to the first other node that sends code to TeX.
+  static void measure(iopipestream& tex, const string& texengine,
+                      mem::list<drawElement *>::iterator p,
+                      mem::list<drawElement *>::iterator end);
   
   void checkbounds();
     
@@ -53,6 +80,22 @@ public:
 
   bool write(texfile *out, const bbox&);
 
+  // Whether the label can be typeset on its own and placed with place().
+  virtual bool placeable() {return true;}
+
+  bool visible() {
+    return !suppress && !pentype.invisible() && enabled && !label.empty();
+  }
+
+  uint64_t fragmentkey();
+
+  // Writes the label as a page for the fragment cache.
+  void writefragment(texfile *out);
+
+  // Draws the label typeset by the fragment cache, where write() would
+  // have TeX put it.
+  void place(pdffile *out);
+
   drawElement *transformed(const transform& t);
   
   void labelwarning(const char *action); 
@@ -77,14 +120,33 @@ public:
   void bounds(bbox& b, iopipestream& tex, boxvector&, bboxlist&);
   
   bool write(texfile *out, const bbox&);
+
+  bool placeable() {return false;}
   
   drawElement *transformed(const transform& t);
 };
 
-void setpen(iopipestream& tex, const string& texengine, const pen& pentype);
+// Selects the font of pentype in TeX, given that the font of lastpen is
+// selected.
+void setpen(iopipestream& tex, const string& texengine, const pen& pentype,
+            pen& lastpen, bool wait);
+void setpen(iopipestream& tex, const string& texengine, const pen& pentype,
+            bool wait=true);
 void texbounds(double& width, double& height, double& depth,
                iopipestream& tex, string& s);
 
+// Finds the dimensions of the label s typeset in the given pen, consulting
+// the label cache before asking TeX.
+void texbounds(double& width, double& height, double& depth,
+               iopipestream& tex, const string& texengine, const pen& pentype,
+               string& s);
+
+// Finds the dimensions of a number of labels, sending them to TeX together
+// rather than waiting for each in turn, and sharing them among the pool of
+// TeX processes.
+void texbounds(iopipestream& tex, const string& texengine,
+               mem::vector<labelquery>& queries);
+
 }
 
 #endif
@@ -26,6 +26,8 @@ public:
 
   bool svg() {return true;}
   
+  bool nativepdf() {return pentype.fillpattern().empty();}
+  
   bool draw(psfile *out);
 
   drawElement *transformed(const transform& t);
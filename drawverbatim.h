@@ -9,6 +9,7 @@
 #define DRAWVERBATIM_H
 
 #include "drawelement.h"
+#include "labelcache.h"
 
 namespace camp {
 
@@ -35,8 +36,11 @@ public:
   void bounds(bbox& b, iopipestream& tex, boxvector&, bboxlist&) {
     if(havebounds) return;
     havebounds=true;
-    if(language == TeX) 
+    if(language == TeX) {
       tex << text << "%" << newl;
+      labelCache.sent(text);
+      processData().texworkers.sent(text);
+    }
     if(userbounds) {
       b += min;
       b += max;
@@ -47,6 +51,10 @@ public:
     return language == TeX;
   }
   
+  bool nativepdf() {
+    return language != PostScript;
+  }
+  
   bool draw(psfile *out) {
     if(language == PostScript) out->verbatimline(text);
     return true;
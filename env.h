@@ -180,6 +180,9 @@ public:
   ~env();
 
   record *getModule(symbol id, string filename);
+
+  // Notes that the code being translated includes the given file.
+  void addInclude(string filename);
 };
 
 } // namespace trans
@@ -0,0 +1,157 @@
+/*****
+ * fragment.cc
+ *
+ * Labels typeset once by pdfTeX and placed as forms in direct PDF output.
+ *****/
+
+#include <sstream>
+#include <iomanip>
+
+#include "fragment.h"
+#include "drawlabel.h"
+#include "labelcache.h"
+#include "texfile.h"
+#include "picture.h"
+#include "settings.h"
+#include "lexical.h"
+#include "util.h"
+
+using namespace settings;
+
+namespace camp {
+
+fragmentcache fragmentCache;
+
+uint64_t fragmentcache::key(const pen& pentype, const string& s)
+{
+  pen p=pentype;
+  p.convert();
+  ostringstream buf;
+  buf << std::setprecision(17);
+  if(p.cmyk())
+    buf << "cmyk " << p.cyan() << " " << p.magenta() << " " << p.yellow()
+        << " " << p.black();
+  else if(p.rgb())
+    buf << "rgb " << p.red() << " " << p.green() << " " << p.blue();
+  else if(p.grayscale())
+    buf << "gray " << p.gray();
+
+  // A label cannot contain a null character.
+  return labelCache.key(getSetting<string>("tex"),p,s+'\0'+buf.str());
+}
+
+const labelfragment *fragmentcache::find(uint64_t key)
+{
+  fragmentMap::iterator p=fragments.find(key);
+  return p == fragments.end() ? NULL : &p->second;
+}
+
+namespace {
+// Reads a number from the PDF array s, such as a media box, advancing pos
+// past it.
+bool readnumber(const string& s, size_t& pos, double& x)
+{
+  size_t start=s.find_first_not_of(" \t\r\n[",pos);
+  if(start == string::npos) return false;
+  pos=s.find_first_of(" \t\r\n]",start);
+  if(pos == string::npos) return false;
+  try {
+    x=lexical::cast<double>(s.substr(start,pos-start));
+  } catch(lexical::bad_cast&) {
+    return false;
+  }
+  return true;
+}
+}
+
+bool fragmentcache::typeset(const string& prefix,
+                            mem::list<drawElement *>& nodes)
+{
+  mem::vector<drawLabel *> labels;
+  mem::vector<uint64_t> keys;
+  mem::map<uint64_t,size_t> pending;
+  for(mem::list<drawElement *>::iterator p=nodes.begin(); p != nodes.end();
+      ++p) {
+    if(!(*p)->islabel()) continue;
+    drawLabel *L=dynamic_cast<drawLabel *>(*p);
+    if(!L || !L->visible()) continue;
+    uint64_t k=L->fragmentkey();
+    // A label that reads files is typeset again for each picture.
+    if((find(k) && !labelCache.istransient(k)) ||
+       pending.find(k) != pending.end()) continue;
+    pending[k]=labels.size();
+    labels.push_back(L);
+    keys.push_back(k);
+  }
+  if(labels.empty()) return true;
+
+  string texname=auxname(prefix+"_labels","tex");
+  string pdfname=auxname(prefix+"_labels","pdf");
+  {
+    bbox b;
+    texfile tex(texname,b);
+    tex.fragmentprologue();
+    for(size_t i=0; i < labels.size(); ++i)
+      labels[i]->writefragment(&tex);
+    tex.epilogue();
+  }
+
+  bool status=opentex(texname,prefix) == 0;
+
+  pdfdocument *doc=new pdfdocument;
+  size_t n=labels.size();
+  if(status && (!doc->read(pdfname) || doc->pages().size() < n))
+    status=false;
+
+  mem::vector<labelfragment> typeset(n);
+  for(size_t i=0; status && i < n; ++i) {
+    labelfragment& f=typeset[i];
+    f.doc=doc;
+    f.page=doc->pages()[i];
+    string dict,stream;
+    double x0,y0,x1,y1;
+    size_t pos=0;
+    string box;
+    if(!doc->object(f.page,dict,stream) ||
+       !readnumber(box=doc->lookup(dict,"/MediaBox"),pos,x0) ||
+       !readnumber(box,pos,y0) || !readnumber(box,pos,x1) ||
+       !readnumber(box,pos,y1)) {
+      status=false;
+      break;
+    }
+    f.origin=pair(x0,y0);
+    f.width=x1-x0;
+    f.height=y1-y0;
+
+    // The depth is written as a TeX dimension, such as (1.94397pt).
+    string depth=doc->lookup(dict,"/ASYdepth");
+    size_t end=depth.rfind("pt)");
+    if(depth.size() < 4 || depth[0] != '(' || end == string::npos) {
+      status=false;
+      break;
+    }
+    try {
+      f.depth=lexical::cast<double>(depth.substr(1,end-1))*tex2ps;
+    } catch(lexical::bad_cast&) {
+      status=false;
+    }
+  }
+
+  if(status)
+    for(size_t i=0; i < n; ++i)
+      fragments[keys[i]]=typeset[i];
+
+  if(!getSetting<bool>("keep")) {
+    unlink(texname.c_str());
+    unlink(pdfname.c_str());
+    unlink(auxname(prefix+"_labels","log").c_str());
+    unlink(auxname(prefix+"_labels","aux").c_str());
+  }
+
+  if(!status && verbose > 0)
+    cerr << "warning: cannot typeset labels separately; using TeX layers"
+         << endl;
+  return status;
+}
+
+}
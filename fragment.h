@@ -0,0 +1,57 @@
+/*****
+ * fragment.h
+ *
+ * Labels typeset once by pdfTeX and placed as forms in direct PDF output.
+ *****/
+
+#ifndef FRAGMENT_H
+#define FRAGMENT_H
+
+#include <cstdint>
+
+#include "common.h"
+#include "pair.h"
+#include "pen.h"
+#include "pdfreader.h"
+
+namespace camp {
+
+class drawElement;
+
+// A label, as a page of a PDF file written by pdfTeX.  The page is the box
+// of the label, whose baseline lies depth above the bottom edge; origin is
+// the lower left corner of its media box.
+struct labelfragment {
+  const pdfdocument *doc;
+  size_t page;
+  pair origin;
+  double width,height,depth;
+};
+
+// Caches the labels typeset in this process, so that each distinct label is
+// sent to TeX only once, however many pictures or frames it appears in.
+// Labels are identified as in the label cache, by the TeX engine and
+// preamble, the font, and the label itself, together with the color of the
+// pen.  Labels that read files, which the label cache does not keep, are
+// typeset again for each picture.
+class fragmentcache {
+  typedef mem::map<uint64_t,labelfragment> fragmentMap;
+  fragmentMap fragments;
+
+public:
+  static uint64_t key(const pen& p, const string& s);
+
+  // Looks up a label, returning NULL if it has not been typeset.
+  const labelfragment *find(uint64_t key);
+
+  // Typesets the visible labels among nodes that have not been typeset
+  // already, in one TeX run, using prefix to name the intermediate files.
+  // Returns false if TeX fails or its output cannot be read.
+  bool typeset(const string& prefix, mem::list<drawElement *>& nodes);
+};
+
+extern fragmentcache fragmentCache;
+
+}
+
+#endif
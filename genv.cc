@@ -14,8 +14,10 @@
  *****/
 
 #include <sstream>
+#include <fstream>
 #include <unistd.h>
 #include <algorithm>
+#include <cstdint>
 
 #include "genv.h"
 #include "env.h"
@@ -38,6 +40,93 @@ types::record *transExternalModule(trans::genv& ge, string filename, symbol id);
 
 namespace trans {
 
+namespace {
+// Hashes the contents of a file (using FNV-1a), returning false if it cannot
+// be read.
+bool hashFile(const string& file, uint64_t& hash)
+{
+  std::ifstream in(file.c_str(), std::ios::binary);
+  if (!in)
+    return false;
+
+  hash=14695981039346656037ULL;
+  char buf[8192];
+  while (in) {
+    in.read(buf, sizeof(buf));
+    std::streamsize n=in.gcount();
+    for (std::streamsize i=0; i < n; ++i) {
+      hash ^= (unsigned char) buf[i];
+      hash *= 1099511628211ULL;
+    }
+  }
+  return !in.bad();
+}
+
+// A source file and a hash of its contents.
+struct source {
+  string file;
+  uint64_t hash;
+
+  source(string file, uint64_t hash)
+    : file(file), hash(hash) {}
+
+  bool current() {
+    uint64_t h;
+    return hashFile(file, h) && h == hash;
+  }
+};
+}
+
+// A translated module.  A genv is created for each file processed, and the
+// translation is reused by later ones instead of parsing and translating the
+// module again, as long as the source file, the settings that affect
+// translation, and the modules it imports are unchanged.
+struct cachedModule : public gc {
+  record *r;
+  string file;
+  uint64_t hash;
+  bool autoplain;
+  bool optimize;
+
+  // False if the module depends on a module or file that could not be
+  // cached.
+  bool complete;
+
+  // The modules imported, indexed by filename; null for builtin modules.
+  typedef mem::map<CONST string,cachedModule *> importMap;
+  importMap imports;
+
+  // The files included in the module.
+  mem::vector<source> includes;
+
+  cachedModule(string file, uint64_t hash)
+    : r(0), file(file), hash(hash),
+      autoplain(getSetting<bool>("autoplain")), optimize(settings::optimize),
+      complete(true) {}
+
+  // Checks that filename still refers to the unmodified source file, and
+  // that the included files are also unmodified.
+  bool current(string filename) {
+    uint64_t h;
+    if (autoplain != getSetting<bool>("autoplain") ||
+        optimize != settings::optimize ||
+        settings::locateFile(filename) != file ||
+        !hashFile(file, h) || h != hash)
+      return false;
+
+    for (mem::vector<source>::iterator p=includes.begin();
+         p != includes.end(); ++p)
+      if (!p->current())
+        return false;
+
+    return true;
+  }
+};
+
+// The module cache, indexed by source file.
+typedef mem::map<CONST string,cachedModule *> moduleCache;
+moduleCache modules;
+
 genv::genv()
   : imap()
 {
@@ -72,20 +161,123 @@ record *genv::loadModule(symbol id, string filename) {
   }
 #endif
 
+  string file=settings::locateFile(filename);
+  uint64_t hash;
+  cachedModule *m=0;
+  if (!file.empty() && hashFile(file, hash)) {
+    cachedModule *old=modules[file];
+    std::set<cachedModule *> checked;
+    if (old && reusable(filename, old, checked)) {
+      if (settings::verbose > 1)
+        cerr << "Reusing " << filename << " from " << file << endl;
+      reuse(filename, old);
+      return old->r;
+    }
+    m=new cachedModule(file, hash);
+  }
+
   // Get the abstract syntax tree.
   absyntax::file *ast = parser::parseFile(filename,"Loading");
 
   inTranslation.push_front(filename);
+  if (m)
+    collecting.push_front(m);
 
   em.sync();
 
+  codeStats before=translatedCode;
   record *r=ast->transAsFile(*this, id);
+
+  if (settings::verbose > 2) {
+    size_t n=translatedCode.instructions-before.instructions;
+    cerr << "Bytecode of " << filename << ": " << n << " instructions in "
+         << translatedCode.codeBytes-before.codeBytes << " bytes ("
+         << n*(sizeof(vm::inst)+sizeof(position))
+         << " with inline positions), positions in "
+         << translatedCode.posBytes-before.posBytes << " bytes" << endl;
+  }
   
   inTranslation.remove(filename);
+  if (m) {
+    collecting.pop_front();
+    if (!m->complete || em.errors())
+      m=0;
+    else {
+      m->r=r;
+      modules[file]=m;
+    }
+  }
+  cached[filename]=m;
 
   return r;
 }
 
+bool genv::reusable(string filename, cachedModule *m,
+                    std::set<cachedModule *>& checked)
+{
+  if (!checked.insert(m).second)
+    return true;
+
+  // A module already loaded under this name must be the same translation.
+  importMap::iterator p=imap.find(filename);
+  if (p != imap.end() && p->second)
+    return p->second == m->r;
+
+  if (!m->current(filename))
+    return false;
+
+  for (cachedModule::importMap::iterator q=m->imports.begin();
+       q != m->imports.end(); ++q)
+    if (q->second && !reusable(q->first, q->second, checked))
+      return false;
+
+  return true;
+}
+
+void genv::reuse(string filename, cachedModule *m)
+{
+  if (imap[filename])
+    return;
+
+  imap[filename]=m->r;
+  cached[filename]=m;
+
+  for (cachedModule::importMap::iterator q=m->imports.begin();
+       q != m->imports.end(); ++q)
+    if (q->second)
+      reuse(q->first, q->second);
+}
+
+void genv::addInclude(string filename)
+{
+  if (collecting.empty())
+    return;
+
+  cachedModule *top=collecting.front();
+  string file=settings::locateFile(filename);
+  uint64_t hash;
+  if (!file.empty() && hashFile(file, hash))
+    top->includes.push_back(source(file, hash));
+  else
+    top->complete=false;
+}
+
+void genv::addDependency(string filename)
+{
+  if (collecting.empty())
+    return;
+
+  cachedModule *top=collecting.front();
+  cachedMap::iterator p=cached.find(filename);
+  if (p == cached.end())
+    // A builtin module, such as settings.
+    top->imports[filename]=0;
+  else if (p->second)
+    top->imports[filename]=p->second;
+  else
+    top->complete=false;
+}
+
 void genv::checkRecursion(string filename) {
   if (find(inTranslation.begin(), inTranslation.end(), filename) !=
       inTranslation.end()) {
@@ -100,18 +292,16 @@ record *genv::getModule(symbol id, string filename) {
   checkRecursion(filename);
 
   record *r=imap[filename];
-  if (r)
-    return r;
-  else {
-    record *r=loadModule(id, filename);
+  if (!r) {
+    r=loadModule(id, filename);
     // Don't add an erroneous module to the dictionary in interactive mode, as
     // the user may try to load it again.
     if (!interact::interactive || !em.errors())
       imap[filename]=r;
-
-    return r;
   }
 
+  addDependency(filename);
+  return r;
 }
 
 typedef vm::stack::importInitMap importInitMap;
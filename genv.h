@@ -16,6 +16,8 @@
 #ifndef GENV_H
 #define GENV_H
 
+#include <set>
+
 #include "common.h"
 #include "table.h"
 #include "record.h"
@@ -29,6 +31,8 @@ using vm::lambda;
 
 namespace trans {
 
+struct cachedModule;
+
 class genv : public gc {
   // The initializer functions for imports, indexed by filename.
   typedef mem::map<CONST string,record *> importMap;
@@ -42,15 +46,37 @@ class genv : public gc {
   // exception if it occurs.
   void checkRecursion(string filename);
 
+  // The module cache entry of each module loaded from a file, indexed by
+  // filename; null if the module could not be cached.
+  typedef mem::map<CONST string,cachedModule *> cachedMap;
+  cachedMap cached;
+
+  // The cache entries of the modules in translation, innermost first.
+  mem::list<cachedModule *> collecting;
+
   // Translate a module to build the record type.
   record *loadModule(symbol name, string s);
 
+  // Checks if a cached module, and all modules it imports, can be reused.
+  bool reusable(string filename, cachedModule *m,
+                std::set<cachedModule *>& checked);
+
+  // Adds a cached module, and all modules it imports, to this environment.
+  void reuse(string filename, cachedModule *m);
+
+  // Records that the module in translation (if any) imports the module
+  // loaded from filename.
+  void addDependency(string filename);
+
 public:
   genv();
 
   // Get an imported module, translating if necessary.
   record *getModule(symbol name, string s);
 
+  // Records that the module in translation (if any) includes the file.
+  void addInclude(string filename);
+
   // Uses the filename->record map to build a filename->initializer map to be
   // used at runtime.
   vm::stack::importInitMap *getInitMap();
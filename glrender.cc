@@ -24,6 +24,7 @@
 #include "bbox3.h"
 #include "drawimage.h"
 #include "interact.h"
+#include "raster.h"
 
 namespace gl {
 #ifdef HAVE_PTHREAD
@@ -560,20 +561,34 @@ void Export()
         cout << count << " tile" << (count != 1 ? "s" : "") << " drawn" << endl;
       trDelete(tr);
 
-      picture pic;
-      double w=oWidth;
-      double h=oHeight;
-      double Aspect=((double) fullWidth)/fullHeight;
-      if(w > h*Aspect) w=(int) (h*Aspect+0.5);
-      else h=(int) (w/Aspect+0.5);
-      // Render an antialiased image.
-      drawRawImage *Image=new drawRawImage(data,fullWidth,fullHeight,
-                                           transform(0.0,0.0,w,0.0,0.0,h),
-                                           antialias);
-      pic.append(Image);
-      pic.shipout(NULL,Prefix,Format,false,View);
-      delete Image;
-      delete[] data;
+      if(camp::rasterformat(Format) && Prefix != "-") {
+        // Encode the image directly, rather than through Ghostscript.
+        string outname=buildname(stripExt(Prefix),Format,"");
+        camp::writeRaster(outname,Format,data,fullWidth,fullHeight,antialias,
+                          !View);
+        if(View) {
+          mem::vector<string> cmd;
+          push_command(cmd,getSetting<string>("display"));
+          cmd.push_back(outname);
+          string application="your "+Format+" viewer";
+          System(cmd,0,false,"display",application.c_str());
+        }
+      } else {
+        picture pic;
+        double w=oWidth;
+        double h=oHeight;
+        double Aspect=((double) fullWidth)/fullHeight;
+        if(w > h*Aspect) w=(int) (h*Aspect+0.5);
+        else h=(int) (w/Aspect+0.5);
+        // Render an antialiased image.
+        drawRawImage *Image=new drawRawImage(data,fullWidth,fullHeight,
+                                             transform(0.0,0.0,w,0.0,0.0,h),
+                                             antialias);
+        pic.append(Image);
+        pic.shipout(NULL,Prefix,Format,false,View);
+        delete Image;
+        delete[] data;
+      }
     } 
   } catch(handled_error) {
   } catch(std::bad_alloc&) {
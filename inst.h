@@ -56,8 +56,19 @@ struct lambda : public gc {
 #endif
 };
 
+// The operand of the savefunc instruction: the function to build out of the
+// current closure, and the local variable where it is stored.
+struct funcslot : public gc {
+  lambda *body;
+  Int index;
+
+  funcslot(lambda *body, Int index)
+    : body(body), index(index) {}
+};
+
 // The code run is just a string of instructions.  The ops are actual commands
 // to be run, but constants, labels, and other objects can be in the code.
+// The source position of each instruction is kept by its program.
 struct inst : public gc {
   enum opcode {
 #define OPCODE(name,type)  name,
@@ -65,8 +76,11 @@ struct inst : public gc {
 #undef OPCODE
   };
   opcode op;
-  position pos;
   item ref;
+#ifdef THREADED_DISPATCH
+  // The address of the code implementing op, filled in by program::thread.
+  const void *handler;
+#endif
 };
 template<typename T>
 inline T get(const inst& it)
@@ -14,6 +14,16 @@
 
 #if COMPACT
 #include <cassert>
+#elif NANBOX
+#include <cassert>
+#include <cstring>
+#include <stdint.h>
+#if UINTPTR_MAX > 0xffffffffU
+#error "NaN-boxed items require 32-bit pointers"
+#endif
+#ifdef DEBUG_STACK
+#include <typeinfo>
+#endif
 #else
 #include <typeinfo>
 #endif
@@ -40,6 +50,27 @@ extern const Int BoolFalseValue;
 inline Int valueFromBool(bool b) {
   return b ? BoolTruthValue : BoolFalseValue;
 }
+#elif NANBOX
+// A NaN-boxed item is a 64-bit word.  Pointers are stored as they are, so
+// that the garbage collector still sees them, and reals are offset by
+// NanBoxRealOffset to make room for the other kinds of value:
+//
+//   0x0000 0000 pppp pppp  pointer (or one of the values below 0x10)
+//   0x0001 0000 pppp pppp  pointer to an Int that does not fit in 32 bits
+//   0x0002 ... 0xfff2      real, offset by NanBoxRealOffset
+//   0xfffe 0000 iiii iiii  Int
+//
+// All NaNs are stored as the same quiet NaN, so every real lies within
+// the range above.
+const uint64_t NanBoxFalse=0x6;
+const uint64_t NanBoxTrue=0x7;
+const uint64_t NanBoxDefault=0xa;
+const uint64_t NanBoxUndefined=0xe;
+const uint64_t NanBoxLastSpecial=0xf;
+const uint64_t NanBoxBigIntTag=0x0001000000000000ULL;
+const uint64_t NanBoxRealOffset=0x0002000000000000ULL;
+const uint64_t NanBoxIntTag=0xfffe000000000000ULL;
+const uint64_t NanBoxQuietNaN=0x7ff8000000000000ULL;
 #endif
   
 extern const item Default;
@@ -47,6 +78,67 @@ extern const item Default;
 class item : public gc {
 private:
   
+#if NANBOX
+  uint64_t bits;
+
+#ifdef DEBUG_STACK
+  // The type a pointer refers to, which the encoding cannot hold, kept only
+  // to check get<T> as the typed representation does.
+  const std::type_info *kind;
+
+  template<class T>
+  void setKind() {kind=&typeid(T);}
+  void clearKind() {kind=NULL;}
+  template<class T>
+  bool isKind() const {return kind != NULL && *kind == typeid(T);}
+#else
+  template<class T>
+  void setKind() {}
+  void clearKind() {}
+  template<class T>
+  bool isKind() const {return true;}
+#endif
+
+  static uint64_t fromInt(Int i) {
+    if ((int32_t) i == i)
+      return NanBoxIntTag | (uint32_t) i;
+    return NanBoxBigIntTag | (uintptr_t) new(PointerFreeGC) Int(i);
+  }
+  static uint64_t fromReal(double x) {
+    uint64_t b;
+    if (x == x)
+      memcpy(&b, &x, sizeof(b));
+    else
+      b=NanBoxQuietNaN;
+    return b+NanBoxRealOffset;
+  }
+  static uint64_t fromPointer(const void *p) {
+    uint64_t b=(uintptr_t) p;
+    assert(b == 0 || b > NanBoxLastSpecial);
+    return b;
+  }
+
+  bool isInt() const
+  {return bits >= NanBoxIntTag || (bits & ~0xffffffffULL) == NanBoxBigIntTag;}
+  bool isReal() const
+  {return bits >= NanBoxRealOffset && bits < NanBoxIntTag;}
+  bool isPointer() const
+  {return bits <= 0xffffffffULL && (bits == 0 || bits > NanBoxLastSpecial);}
+
+  Int toInt() const {
+    if (bits >= NanBoxIntTag)
+      return (int32_t) (uint32_t) bits;
+    return *(Int *) (uintptr_t) (uint32_t) bits;
+  }
+  double toReal() const {
+    uint64_t b=bits-NanBoxRealOffset;
+    double x;
+    memcpy(&x, &b, sizeof(x));
+    return x;
+  }
+  void *toPointer() const
+  {return (void *) (uintptr_t) bits;}
+#else
 #if !COMPACT
   const std::type_info *kind;
 #endif
@@ -59,6 +151,7 @@ private:
 #endif
     void *p;
   };
+#endif
 
 public:
 #if COMPACT    
@@ -86,6 +179,10 @@ public:
   { x=a; return *this; }
   item& operator= (bool b)
   { i=valueFromBool(b); return *this; }
+
+  // The real held by an item, without checking that it is initialized.
+  double real() const
+  { return x; }
   
   template<class T>
   item(T *p)
@@ -95,7 +192,7 @@ public:
   
   template<class T>
   item(const T &p)
-    : p(new(UseGC) T(p)) {
+    : p(new(gcPlacement<T>()) T(p)) {
     assert(!empty());
   }
   
@@ -105,7 +202,52 @@ public:
   
   template<class T>
   item& operator= (const T &it)
-  { p=new(UseGC) T(it); return *this; }
+  { p=new(gcPlacement<T>()) T(it); return *this; }
+#elif NANBOX
+  bool empty() const
+  {return bits == NanBoxUndefined;}
+  
+  item() : bits(NanBoxUndefined) {clearKind();}
+  
+  item(Int i)
+    : bits(fromInt(i)) {clearKind();}
+  item(int i)
+    : bits(fromInt(i)) {clearKind();}
+  item(double x)
+    : bits(fromReal(x)) {clearKind();}
+  item(bool b)
+    : bits(b ? NanBoxTrue : NanBoxFalse) {clearKind();}
+  
+  item& operator= (int a)
+  { bits=fromInt(a); clearKind(); return *this; }
+  item& operator= (unsigned int a)
+  { bits=fromInt(a); clearKind(); return *this; }
+  item& operator= (Int a)
+  { bits=fromInt(a); clearKind(); return *this; }
+  item& operator= (double a)
+  { bits=fromReal(a); clearKind(); return *this; }
+  item& operator= (bool b)
+  { bits=b ? NanBoxTrue : NanBoxFalse; clearKind(); return *this; }
+  
+  template<class T>
+  item(T *p)
+    : bits(fromPointer(p)) {setKind<T>();}
+  
+  template<class T>
+  item(const T &p)
+    : bits(fromPointer(new(gcPlacement<T>()) T(p))) {setKind<T>();}
+  
+  template<class T>
+  item& operator= (T *a)
+  { bits=fromPointer(a); setKind<T>(); return *this; }
+  
+  template<class T>
+  item& operator= (const T &it)
+  { bits=fromPointer(new(gcPlacement<T>()) T(it)); setKind<T>(); return *this; }
+
+  // Makes the item with the given encoding.
+  static item encoded(uint64_t bits)
+  { item it; it.bits=bits; return it; }
 #else    
   bool empty() const
   {return *kind == typeid(void);}
@@ -139,7 +281,7 @@ public:
   
   template<class T>
   item(const T &p)
-    : kind(&typeid(T)), p(new(UseGC) T(p)) {}
+    : kind(&typeid(T)), p(new(gcPlacement<T>()) T(p)) {}
   
   template<class T>
   item& operator= (T *a)
@@ -147,7 +289,7 @@ public:
   
   template<class T>
   item& operator= (const T &it)
-  { kind=&typeid(T); p=new(UseGC) T(it); return *this; }
+  { kind=&typeid(T); p=new(gcPlacement<T>()) T(it); return *this; }
   
   const std::type_info &type() const
   { return *kind; }
@@ -171,6 +313,9 @@ private:
 #if COMPACT      
       if(!it.empty())
         return (T*) it.p;
+#elif NANBOX
+      if(it.isPointer() && it.isKind<T>())
+        return (T*) it.toPointer();
 #else        
       if(*it.kind == typeid(T))
         return (T*) it.p;
@@ -186,6 +331,9 @@ private:
 #if COMPACT      
       if(!it.empty())
         return *(T*) it.p;
+#elif NANBOX
+      if(it.isPointer() && it.bits != 0 && it.isKind<T>())
+        return *(T*) it.toPointer();
 #else      
       if(*it.kind == typeid(T))
         return *(T*) it.p;
@@ -259,6 +407,9 @@ inline Int get<Int>(const item& it)
 #if COMPACT  
   if(!it.empty())
     return it.i;
+#elif NANBOX
+  if(it.isInt())
+    return it.toInt();
 #else
   if(*it.kind == typeid(Int))
     return it.i;
@@ -272,6 +423,9 @@ inline double get<double>(const item& it)
 #if COMPACT  
   if(!it.empty())
     return it.x;
+#elif NANBOX
+  if(it.isReal())
+    return it.toReal();
 #else
   if(*it.kind == typeid(double))
     return it.x;
@@ -287,6 +441,11 @@ inline bool get<bool>(const item& it)
     return true;
   if(it.i == BoolFalseValue)
     return false;
+#elif NANBOX
+  if(it.bits == NanBoxTrue)
+    return true;
+  if(it.bits == NanBoxFalse)
+    return false;
 #else  
   if(*it.kind == typeid(bool))
     return it.b;
@@ -294,7 +453,7 @@ inline bool get<bool>(const item& it)
   throw vm::bad_item_value();
 }
 
-#if !COMPACT
+#if !COMPACT && !NANBOX
 // This serves as the object for representing a default argument.
 struct default_t : public gc {};
 #endif
@@ -303,6 +462,8 @@ inline bool isdefault(const item& it)
 {
 #if COMPACT  
   return it.i == DefaultValue;
+#elif NANBOX
+  return it.bits == NanBoxDefault;
 #else  
   return *it.kind == typeid(default_t);
 #endif  
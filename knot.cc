@@ -323,10 +323,10 @@ weqn scale(weqn q) {
  * 
  * Used as the first step in solve cyclic equations.
  */
-cvector<weqn> recalc(cvector<eqn>& e)
+void recalc(cvector<weqn>& we, cvector<eqn>& e)
 {
   Int n=(Int) e.size();
-  cvector<weqn> we;
+  we.clear();
   weqn lasteqn(0,1,0,0,1);
   we.push_back(lasteqn); // As a placeholder.
   for (Int j=1; j < n; j++) {
@@ -346,7 +346,6 @@ cvector<weqn> recalc(cvector<eqn>& e)
     we.front()=scale(weqn(0,q.piv-q.pre*lasteqn.post,q.post,
                           q.aug-q.pre*lasteqn.aug,-q.pre*lasteqn.w));
   }
-  return we;
 }
 
 double solveForTheta0(cvector<weqn>& we)
@@ -382,10 +381,10 @@ double solveForTheta0(cvector<weqn>& we)
   return a/(1.0-(b+c));
 }
 
-cvector<double> backsubCyclic(cvector<weqn>& we, double theta0)
+void backsubCyclic(cvector<double>& thetas, cvector<weqn>& we, double theta0)
 {
   Int n=(Int) we.size();
-  cvector<double> thetas;
+  thetas.clear();
   double lastTheta=theta0;
   for (Int j=1;j<=n;++j)
     {
@@ -396,7 +395,6 @@ cvector<double> backsubCyclic(cvector<weqn>& we, double theta0)
       lastTheta=theta;
     }
   reverse(thetas.begin(),thetas.end());
-  return thetas;
 }
 
 // For the non-cyclic equations, do row operation to put the matrix into
@@ -458,29 +456,43 @@ struct backsub : public knotprop<double> {
   // start is the same as mid.
 };
 
+// Storage for solving the sections of a path, reused from one section to
+// the next.
+struct sectionSpace {
+  cvector<pair> dz;
+  cvector<double> d;
+  cvector<double> psi;
+  cvector<eqn> e;
+  cvector<eqn> el;
+  cvector<weqn> we;
+  cvector<double> theta;
+  cvector<pair> post;
+  cvector<pair> pre;
+};
+
 // Once the equations have been determined, solve for the thetas.
-cvector<double> solveThetas(knotlist& l, cvector<eqn>& e)
+void solveThetas(cvector<double>& theta, knotlist& l, cvector<eqn>& e,
+                 sectionSpace& s)
 {
   if (homogeneous(e))
     // We are solving Ax=0, so a solution is zero for every theta.
-    return cvector<double>(e.size(),0);
+    theta.assign(e.size(),0);
   else if (l.cyclic()) {
     // The knotprop template is unusually unhelpful in this case, so I
     // won't use it here. The algorithm breaks into three passes on the
     // object.  The old Asymptote code used a two-pass method, but I
     // implemented this to stay closer to the MetaPost source code.
-    // This might be something to look at for optimization.
-    cvector<weqn> we=recalc(e);
-    INFO(we);
-    double theta0=solveForTheta0(we);
-    return backsubCyclic(we, theta0);
+    recalc(s.we,e);
+    INFO(s.we);
+    double theta0=solveForTheta0(s.we);
+    backsubCyclic(theta,s.we,theta0);
   }
   else { /* Non-cyclic case. */
     /* First do row operations to get it into reduced echelon form. */
-    cvector<eqn> el=ref(l,e).compute();
+    ref(l,e).compute(s.el);
 
     /* Then, do back substitution. */
-    return backsub(l,el).backCompute();
+    backsub(l,s.el).backCompute(theta);
   }
 }
 
@@ -615,35 +627,40 @@ void encodeStraight(protopath& p, Int k, knotlist& l)
   }
 }
 
-void solveSection(protopath& p, Int k, knotlist& l)
+void solveSection(protopath& p, Int k, knotlist& l, sectionSpace& s)
 {
   if (l.length()>0) {
     info(cerr, "solving section", l);
 
     // Calculate useful properties.
-    cvector<pair>   dz  =  dzprop(l)   .compute();
-    cvector<double> d   =   dprop(l,dz).compute();
-    cvector<double> psi = psiprop(l,dz).compute();
+    cvector<pair>&   dz  = s.dz;
+    cvector<double>& d   = s.d;
+    cvector<double>& psi = s.psi;
+    dzprop(l)   .compute(dz);
+    dprop(l,dz) .compute(d);
+    psiprop(l,dz).compute(psi);
 
     INFO(dz); INFO(d); INFO(psi);
 
     // Build and solve the linear equations for theta.
-    cvector<eqn>        e = eqnprop(l,d,psi).compute();
+    cvector<eqn>& e = s.e;
+    eqnprop(l,d,psi).compute(e);
     INFO(e);
 
     if (straightSection(e))
       // Handle straight section as special case.
       encodeStraight(p,k,l);
     else {
-      cvector<double> theta = solveThetas(l,e);
+      cvector<double>& theta = s.theta;
+      solveThetas(theta,l,e,s);
       INFO(theta);
 
       // Calculate the control points.
-      cvector<pair> post = postcontrolprop(l,dz,psi,theta).compute();
-      cvector<pair> pre  =  precontrolprop(l,dz,psi,theta).compute();
+      postcontrolprop(l,dz,psi,theta).compute(s.post);
+      precontrolprop(l,dz,psi,theta).compute(s.pre);
 
       // Encode the results into the protopath.
-      encodeControls(p,k,pre,l,post).exec();
+      encodeControls(p,k,s.pre,l,s.post).exec();
     }
   }
 }
@@ -693,11 +710,12 @@ void writeControls(protopath& p, Int a, knotlist& l)
 path solveSpecified(knotlist& l)
 {
   protopath p(l.size(),l.cyclic());
+  sectionSpace s;
 
   Int first=firstBreakpoint(l);
   if (first==NOBREAK)
     /* We are solving a fully cyclic path, so do it in one swoop. */
-    solveSection(p,0,l);
+    solveSection(p,0,l,s);
   else {
     // Encode the first point.
     p.point(first)=l[first].z;
@@ -720,7 +738,7 @@ path solveSpecified(knotlist& l)
         // from index a into our protopath.
         Int b=nextBreakpoint(l,a);
         subknotlist section(l,a,b);
-        solveSection(p,a,section);
+        solveSection(p,a,section,s);
         a=b;
       }
     }
@@ -798,6 +816,39 @@ path solve(knotlist& l)
   }
 }
 
+path solve(const mem::vector<pair>& z, bool cyclic,
+           const mem::vector<double>& t, const mem::vector<pair>& dir)
+{
+  static spec open;
+
+  size_t n=z.size();
+  if(n == 0) return path();
+  if(t.size() > 0 && t.size() < (cyclic ? n : n-1))
+    reportError("too few tensions");
+  if(dir.size() > 0 && dir.size() < n)
+    reportError("too few directions");
+
+  simpleknotlist l(cvector<knot>(),cyclic);
+  cvector<knot>& nodes=l.nodes;
+  nodes.reserve(n);
+  for(size_t i=0; i < n; ++i) {
+    // As for {dir[i]}z[i], partnerUp supplies the outgoing direction.
+    spec *in=&open;
+    if(dir.size() > 0 && dir[i] != pair(0,0))
+      in=new dirSpec(dir[i]);
+    nodes.push_back(knot(z[i],in,&open));
+  }
+  if(t.size() > 0) {
+    size_t m=cyclic ? n : n-1;
+    for(size_t i=0; i < m; ++i) {
+      tension T(t[i]);
+      nodes[i].tout=T;
+      nodes[(i+1) % n].tin=T;
+    }
+  }
+  return solve(l);
+}
+
 // Code for Testing
 #if 0
 path solveSimple(cvector<pair>& z)
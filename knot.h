@@ -347,10 +347,10 @@ protected:
     return mid(j);
   }
 
-  virtual cvector<T> linearCompute()
+  virtual void linearCompute(cvector<T>& v)
   {
     Int n=l.length();
-    cvector<T> v;
+    v.clear();
     if (n==0)
       v.push_back(solo(0));
     else {
@@ -359,22 +359,20 @@ protected:
         v.push_back(mid(j));
       v.push_back(end(n));
     }
-    return v;
   }
   
-  virtual cvector<T> cyclicCompute()
+  virtual void cyclicCompute(cvector<T>& v)
   {
     Int n=l.length();
-    cvector<T> v;
+    v.clear();
     for (Int j=0; j<n; ++j)
       v.push_back(mid(j));
-    return v;
   }
 
-  virtual cvector<T> linearBackCompute()
+  virtual void linearBackCompute(cvector<T>& v)
   {
     Int n=l.length();
-    cvector<T> v;
+    v.clear();
     if (n==0)
       v.push_back(solo(0));
     else {
@@ -383,34 +381,50 @@ protected:
         v.push_back(mid(n-j));
       v.push_back(start(0));
     }
-    return v;
   }
   
-  virtual cvector<T> cyclicBackCompute()
+  virtual void cyclicBackCompute(cvector<T>& v)
   {
     Int n=l.length();
-    cvector<T> v;
+    v.clear();
     for (Int j=1; j<=n; ++j)
       v.push_back(mid(n-j));
-    return v;
   }
 
 public:
   virtual ~knotprop() {}
   
-  virtual cvector<T> compute() {
-    return l.cyclic() ? cyclicCompute() : linearCompute();
+  // Computes the values into v, reusing its storage.
+  void compute(cvector<T>& v) {
+    if (l.cyclic())
+      cyclicCompute(v);
+    else
+      linearCompute(v);
+  }
+
+  cvector<T> compute() {
+    cvector<T> v;
+    compute(v);
+    return v;
   }
 
   // Compute the values in the opposite order.  This is needed for instance if
   // the i-th calculation needed a result computed in the i+1-th, such as in the
   // back substitution for solving thetas.
-  virtual cvector<T> backCompute() {
-    cvector<T> v=l.cyclic() ? cyclicBackCompute() : linearBackCompute();
+  void backCompute(cvector<T>& v) {
+    if (l.cyclic())
+      cyclicBackCompute(v);
+    else
+      linearBackCompute(v);
 
     // Even though they are computed in the backwards order, return them in the
     // standard order.
     reverse(v.begin(),v.end());
+  }
+
+  cvector<T> backCompute() {
+    cvector<T> v;
+    backCompute(v);
     return v;
   }
 
@@ -521,6 +535,13 @@ public:
 
 path solve(knotlist& l);
 
+// Solves the path z[0]..z[1].. ... ..z[n-1], closed with ..cycle if cyclic.
+// If tension is nonempty, tension[i] is used on both sides of the join from
+// z[i]; if dir is nonempty, a nonzero dir[i] is the direction of the path
+// through z[i].
+path solve(const mem::vector<pair>& z, bool cyclic,
+           const mem::vector<double>& tension, const mem::vector<pair>& dir);
+
 path solveSimple(cvector<pair>& z);
 
 double velocity(double theta, double phi, tension t);
@@ -0,0 +1,229 @@
+/*****
+ * labelcache.cc
+ *
+ * A persistent cache of the dimensions of labels typeset by TeX.
+ *****/
+
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "labelcache.h"
+#include "settings.h"
+#include "process.h"
+
+using namespace settings;
+
+namespace camp {
+
+labelcache labelCache;
+
+namespace {
+// Hashes a string using FNV-1a.
+uint64_t hash(const string& s, uint64_t h=14695981039346656037ULL)
+{
+  for(string::const_iterator p=s.begin(); p != s.end(); ++p) {
+    h ^= (unsigned char) *p;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// Returns whether the TeX code s may read a file, such as an image included
+// with \includegraphics or a file read with \input.
+bool readsFiles(const string& s)
+{
+  static const char *commands[]={"\\input","\\include","\\openin",
+                                 "\\read","\\verbatiminput",
+                                 "\\lstinputlisting","\\IfFileExists",
+                                 "\\InputIfFileExists"};
+  if(s.find('\\') == string::npos) return false;
+  for(size_t i=0; i < sizeof(commands)/sizeof(*commands); ++i)
+    if(s.find(commands[i]) != string::npos) return true;
+  return false;
+}
+
+// Holds an exclusive lock on the cache file while in scope, so that
+// compaction and appends by concurrent processes do not interleave.
+class cachelock {
+  int fd;
+public:
+  cachelock(const string& name)
+    : fd(open((name+".lock").c_str(),O_RDWR | O_CREAT,0600)) {
+    if(fd >= 0) flock(fd,LOCK_EX);
+  }
+  ~cachelock() {
+    if(fd >= 0) close(fd);
+  }
+};
+
+// Returns the inode of the file name, or 0 if it does not exist.
+ino_t inode(const string& name)
+{
+  struct stat buf;
+  return stat(name.c_str(),&buf) == 0 ? buf.st_ino : 0;
+}
+}
+
+string labelcache::filename()
+{
+  return initdir+dirsep+"labelcache";
+}
+
+void labelcache::load()
+{
+  loaded=true;
+  string name=filename();
+  cachelock lock(name);
+  std::ifstream fin(name.c_str());
+  if(!fin) return;
+
+  // Each line holds a key, in hexadecimal, and the width, height and depth
+  // of the label.  Later entries replace earlier ones.  Malformed lines, such
+  // as one left incomplete by an interrupted run, are dropped.
+  typedef std::pair<uint64_t,labeldims> entry;
+  mem::vector<entry> entries;
+  size_t lines=0;
+  string line;
+  while(getline(fin,line)) {
+    ++lines;
+    istringstream in(line);
+    entry e;
+    string rest;
+    if(in >> std::hex >> e.first >> std::dec >> e.second.width
+       >> e.second.height >> e.second.depth && !(in >> rest))
+      entries.push_back(e);
+  }
+  fin.close();
+
+  mem::vector<entry> kept;
+  for(size_t i=entries.size(); i-- > 0 && kept.size() < maxentries;) {
+    const entry& f=entries[i];
+    if(dims.find(f.first) == dims.end()) {
+      dims[f.first]=f.second;
+      kept.push_back(f);
+    }
+  }
+
+  if(verbose > 1)
+    cerr << "Read " << dims.size() << " label dimensions from "
+         << name << endl;
+
+  if(kept.size() < lines) {
+    std::reverse(kept.begin(),kept.end());
+    compact(kept);
+  }
+}
+
+// Rewrites the cache file with the given entries; the caller holds the lock.
+void labelcache::compact(const mem::vector<std::pair<uint64_t,labeldims> >&
+                         entries)
+{
+  string name=filename();
+  string tmp=name+".XXXXXX";
+  std::vector<char> buf(tmp.c_str(),tmp.c_str()+tmp.size()+1);
+  int fd=mkstemp(&buf[0]);
+  if(fd < 0) return;
+  close(fd);
+  tmp=&buf[0];
+  {
+    std::ofstream fout(tmp.c_str());
+    fout << std::setprecision(17);
+    for(size_t i=0; i < entries.size(); ++i) {
+      const labeldims& d=entries[i].second;
+      fout << std::hex << entries[i].first << std::dec << " "
+           << d.width << " " << d.height << " " << d.depth << "\n";
+    }
+    if(!fout) {
+      fout.close();
+      std::remove(tmp.c_str());
+      return;
+    }
+  }
+  if(std::rename(tmp.c_str(),name.c_str()) != 0)
+    std::remove(tmp.c_str());
+  else if(verbose > 1)
+    cerr << "Compacted " << name << " to " << entries.size() << " entries"
+         << endl;
+}
+
+void labelcache::sent(const string& s)
+{
+  context=hash(s,context ^ 1099511628211ULL);
+  if(readsFiles(s)) contextReadsFiles=true;
+}
+
+uint64_t labelcache::key(const string& texengine, const pen& p,
+                         const string& s)
+{
+  ostringstream buf;
+  buf << std::setprecision(17) << context << '\0'
+      << texengine << '\0' << getSetting<string>("texcommand") << '\0';
+
+  mem::list<string>& preamble=processData().TeXpreamble;
+  for(mem::list<string>::iterator q=preamble.begin(); q != preamble.end();
+      ++q)
+    buf << *q << '\0';
+
+  buf << p.Font() << '\0' << p.size() << ' ' << p.Lineskip() << '\0';
+  uint64_t k=hash(s,hash(buf.str()));
+
+  if(contextReadsFiles || readsFiles(s) || readsFiles(buf.str()))
+    transient.insert(k);
+  return k;
+}
+
+bool labelcache::find(uint64_t key, labeldims& d)
+{
+  if(!getSetting<bool>("labelcache") || transient.count(key)) return false;
+  if(!loaded) load();
+
+  dimsMap::iterator p=dims.find(key);
+  if(p == dims.end()) {
+    ++misses;
+    return false;
+  }
+  ++hits;
+  d=p->second;
+  return true;
+}
+
+void labelcache::store(uint64_t key, const labeldims& d)
+{
+  if(!getSetting<bool>("labelcache") || transient.count(key)) return;
+  dims[key]=d;
+
+  string name=filename();
+  cachelock lock(name);
+
+  // Reopen the file if it was replaced by a compaction since it was opened.
+  if(out && outinode != inode(name)) {
+    delete out;
+    out=NULL;
+  }
+  if(!out) {
+    out=new std::ofstream(name.c_str(),std::ios::app);
+    outinode=inode(name);
+    if(!*out && verbose > 1)
+      cerr << "Cannot write label cache " << name << endl;
+  }
+  if(*out) {
+    *out << std::hex << key << std::dec << std::setprecision(17) << " "
+         << d.width << " " << d.height << " " << d.depth << "\n";
+    out->flush();
+  }
+}
+
+void labelcache::stats(ostream& out)
+{
+  if(hits+misses > 0)
+    out << "Label cache: " << hits << " hits, " << misses << " misses"
+        << endl;
+}
+
+}
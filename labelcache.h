@@ -0,0 +1,102 @@
+/*****
+ * labelcache.h
+ *
+ * A persistent cache of the dimensions of labels typeset by TeX.
+ *****/
+
+#ifndef LABELCACHE_H
+#define LABELCACHE_H
+
+#include <fstream>
+#include <cstdint>
+#include <set>
+#include <sys/types.h>
+
+#include "common.h"
+#include "pen.h"
+
+namespace camp {
+
+// The dimensions of a label, in PostScript units.
+struct labeldims {
+  double width;
+  double height;
+  double depth;
+
+  labeldims() : width(0.0), height(0.0), depth(0.0) {}
+  labeldims(double width, double height, double depth)
+    : width(width), height(height), depth(depth) {}
+};
+
+// Caches the dimensions of labels across runs, in the file labelcache in the
+// configuration directory.  A label is identified by a hash of the TeX
+// engine, the TeX preamble and other code sent to the pipe, the font selected
+// by the pen, and the label itself, which together determine what the TeX
+// pipe would report unless some of that code reads files; such labels are
+// not cached.  The file is compacted when it is read, keeping only the most
+// recent entry for each label and at most maxentries labels.  Processes that
+// share the file serialize compaction and appends with a lock file.
+class labelcache {
+  typedef mem::map<uint64_t,labeldims> dimsMap;
+  dimsMap dims;
+
+  // The keys of labels that depend on the contents of files.
+  std::set<uint64_t> transient;
+
+  bool loaded;
+  std::ofstream *out;
+
+  // The inode of the file that out appends to.
+  ino_t outinode;
+
+  // A hash of the TeX code sent to the pipe, other than labels, since it
+  // was started.
+  uint64_t context;
+
+  // Whether any of that code reads files.
+  bool contextReadsFiles;
+
+  size_t hits;
+  size_t misses;
+
+  string filename();
+  void load();
+  void compact(const mem::vector<std::pair<uint64_t,labeldims> >& entries);
+
+public:
+  static const size_t maxentries=100000;
+
+  labelcache() : loaded(false), out(0), outinode(0), context(0),
+                 contextReadsFiles(false), hits(0), misses(0) {}
+  ~labelcache() {delete out;}
+
+  // Called when the TeX pipe is started.
+  void reset() {
+    context=0;
+    contextReadsFiles=false;
+  }
+
+  // Records TeX code sent to the pipe that may affect later labels.
+  void sent(const string& s);
+
+  // The key of the label s typeset in the pen p.
+  uint64_t key(const string& texengine, const pen& p, const string& s);
+
+  // Whether the label of key depends on the contents of files.
+  bool istransient(uint64_t key) {return transient.count(key) > 0;}
+
+  // Looks up the dimensions of a label, returning false if they are unknown.
+  bool find(uint64_t key, labeldims& d);
+
+  // Records the dimensions of a label, as reported by TeX.
+  void store(uint64_t key, const labeldims& d);
+
+  // Print the hit and miss statistics.
+  void stats(ostream& out);
+};
+
+extern labelcache labelCache;
+
+}
+
+#endif
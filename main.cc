@@ -28,6 +28,7 @@
 #include <cerrno>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #define GC_PTHREAD_SIGMASK_NEEDED
 
@@ -45,6 +46,9 @@
 #include "fileio.h"
 
 #include "stack.h"
+#include "labelcache.h"
+#include "server.h"
+#include "raster.h"
 
 using namespace settings;
 
@@ -56,7 +60,7 @@ void purge();
 
 #ifdef PROFILE
 namespace vm {
-extern void dumpProfile();
+extern void dumpProfile(const string& name);
 };
 #endif
 
@@ -122,6 +126,165 @@ struct Args
   Args(int argc, char **argv) : argc(argc), argv(argv) {}
 };
 
+// The number of this worker of processFiles, counting from 1, or 0 outside
+// the workers.
+int worker=0;
+
+// The completion of a file by a worker.
+struct result {
+  int worker;
+  int file;
+  bool failed;
+};
+
+string contents(int fd)
+{
+  string s;
+  char buf[BUFSIZ];
+  off_t offset=0;
+  ssize_t n;
+  while((n=pread(fd,buf,sizeof(buf),offset)) > 0) {
+    s.append(buf,n);
+    offset += n;
+  }
+  return s;
+}
+
+// Processes the n input files with the given number of forked workers, which
+// start with plain and any autoimport module already translated.  Each worker
+// writes the output of a file to its own temporary files, which are copied to
+// standard output and error in the order of the files.  The workers also
+// return once they are done, to finish as a sequential run would.
+void processFiles(Args *args, int n, int jobs)
+{
+  mem::vector<string> modules;
+  string autoimport=getSetting<string>("autoimport");
+  if(!autoimport.empty()) modules.push_back(autoimport);
+  try {
+    preloadModules(modules);
+  } catch(handled_error) {
+  }
+  em.clear();
+
+  if(jobs > n) jobs=n;
+  int results[2];
+  if(pipe(results) == -1)
+    camp::reportError("Cannot create pipe");
+
+  mem::vector<int> commands(jobs), out(jobs), err(jobs), pids(jobs);
+  cout.flush(); // Flush stdout to avoid duplicate output.
+  cerr.flush();
+  for(int w=0; w < jobs; ++w) {
+    int command[2];
+    FILE *o=tmpfile(), *e=tmpfile();
+    if(pipe(command) == -1 || !o || !e)
+      camp::reportError("Cannot create temporary files");
+    out[w]=fileno(o);
+    err[w]=fileno(e);
+
+    pids[w]=fork();
+    if(pids[w] == -1)
+      camp::reportError("Cannot fork process");
+    if(pids[w] == 0) {
+      worker=w+1;
+      close(results[0]);
+      close(command[1]);
+      for(int i=0; i < w; ++i)
+        close(commands[i]);
+      int stdoutfd=dup(STDOUT_FILENO);
+      int stderrfd=dup(STDERR_FILENO);
+      dup2(out[w],STDOUT_FILENO);
+      dup2(err[w],STDERR_FILENO);
+      int file;
+      while(read(command[0],&file,sizeof(file)) == sizeof(file) &&
+            file >= 0) {
+        if(ftruncate(STDOUT_FILENO,0) != 0 ||
+           ftruncate(STDERR_FILENO,0) != 0)
+          break;
+        lseek(STDOUT_FILENO,0,SEEK_SET);
+        lseek(STDERR_FILENO,0,SEEK_SET);
+        processFile(string(getArg(file)),true);
+        try {
+          setOptions(args->argc,args->argv);
+        } catch(handled_error) {
+          em.statusError();
+        }
+        cout.flush();
+        cerr.flush();
+        result r={w,file,!em.processStatus()};
+        if(write(results[1],&r,sizeof(r)) != sizeof(r)) break;
+      }
+      dup2(stdoutfd,STDOUT_FILENO);
+      dup2(stderrfd,STDERR_FILENO);
+      return;
+    }
+    close(command[0]);
+    commands[w]=command[1];
+  }
+  close(results[1]);
+
+  // A worker that dies leaves its file unfinished.
+  Signal(SIGPIPE,SIG_IGN);
+
+  mem::vector<int> assigned(jobs,-1);
+  mem::vector<string> outputs(n), errors(n);
+  mem::vector<bool> done(n,false);
+  bool failed=false;
+  int next=0, printed=0;
+
+  for(int w=0; w < jobs; ++w) {
+    assigned[w]=next++;
+    if(write(commands[w],&assigned[w],sizeof(int)) != sizeof(int))
+      assigned[w]=-1;
+  }
+
+  result r;
+  while(read(results[0],&r,sizeof(r)) == sizeof(r)) {
+    int w=r.worker;
+    outputs[r.file]=contents(out[w]);
+    errors[r.file]=contents(err[w]);
+    done[r.file]=true;
+    if(r.failed) failed=true;
+
+    int file=next < n ? next++ : -1;
+    assigned[w]=file;
+    if(write(commands[w],&file,sizeof(int)) != sizeof(int))
+      assigned[w]=-1;
+
+    for(; printed < n && done[printed]; ++printed) {
+      cout << outputs[printed] << std::flush;
+      cerr << errors[printed] << std::flush;
+      outputs[printed]=errors[printed]="";
+    }
+  }
+
+  for(int w=0; w < jobs; ++w) {
+    close(commands[w]);
+    int status;
+    while(waitpid(pids[w],&status,0) == -1 && errno == EINTR);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      failed=true;
+    int file=assigned[w];
+    if(file >= 0 && !done[file]) {
+      outputs[file]=contents(out[w]);
+      errors[file]=contents(err[w]);
+      done[file]=true;
+    }
+    close(out[w]);
+    close(err[w]);
+  }
+  close(results[0]);
+  Signal(SIGPIPE,SIG_DFL);
+
+  for(; printed < n; ++printed) {
+    if(!done[printed]) failed=true;
+    cout << outputs[printed] << std::flush;
+    cerr << errors[printed] << std::flush;
+  }
+
+  if(failed) em.statusError();
+}
+
 void *asymain(void *A)
 {
   setsignal(signalHandler);
@@ -157,22 +320,38 @@ void *asymain(void *A)
         if(inpipe < 0) break;
       }
     } else {
-      for(int ind=0; ind < n; ind++) {
-        processFile(string(getArg(ind)),n > 1);
-        try {
-          if(ind < n-1)
-            setOptions(args->argc,args->argv);
-        } catch(handled_error) {
-          em.statusError();
+      int jobs=intcast(getSetting<Int>("jobs"));
+      if(jobs > 1 && n > 1)
+        processFiles(args,n,jobs);
+      else {
+        for(int ind=0; ind < n; ind++) {
+          processFile(string(getArg(ind)),n > 1);
+          try {
+            if(ind < n-1)
+              setOptions(args->argc,args->argv);
+          } catch(handled_error) {
+            em.statusError();
+          }
         }
       }
     }
   }
 
+  // Files still being written in the background count toward the status.
+  try {
+    camp::finishRaster();
+  } catch(handled_error) {
+    em.statusError();
+  }
+
 #ifdef PROFILE
-  vm::dumpProfile();
+  // Each worker writes its own profile.
+  vm::dumpProfile(worker ? "asyprof."+String(worker) : "asyprof");
 #endif
 
+  if(verbose > 1)
+    camp::labelCache.stats(cerr);
+
   if(getSetting<bool>("wait")) {
     int status;
     while(wait(&status) > 0);
@@ -207,6 +386,15 @@ int main(int argc, char *argv[])
     em.statusError();
   }
 
+  try {
+    if(!getSetting<string>("server").empty())
+      camp::serve(argc,argv);
+    else if(!getSetting<string>("connect").empty())
+      exit(camp::client(argc,argv));
+  } catch(handled_error) {
+    exit(1);
+  }
+
   Args args(argc,argv);
 #ifdef HAVE_GL
 #ifdef __APPLE__
@@ -110,14 +110,32 @@ inline void* operator new[](size_t size, GCPlacement) {
   return operator new(size);
 }
 
+struct GC_true_type {};
+struct GC_false_type {};
+
 template<class T>
-struct GC_type_traits {};
+struct GC_type_traits {
+  GC_false_type GC_is_ptr_free;
+};
 
 #define GC_DECLARE_PTRFREE(T)                   \
-  template<> struct GC_type_traits<T> {}
+  template<> struct GC_type_traits<T> {         \
+    GC_true_type GC_is_ptr_free;                \
+  }
 
 #endif // USEGC
 
+// The placement for allocating an object of type T: types declared with
+// GC_DECLARE_PTRFREE are not scanned by the garbage collector.
+inline GCPlacement gcPlacement(GC_true_type) {return PointerFreeGC;}
+inline GCPlacement gcPlacement(GC_false_type) {return UseGC;}
+
+template<class T>
+inline GCPlacement gcPlacement()
+{
+  return gcPlacement(GC_type_traits<T>().GC_is_ptr_free);
+}
+
 namespace mem {
 
 #define GC_CONTAINER(KIND)                                              \
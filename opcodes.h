@@ -14,6 +14,7 @@
  *   b - builtin
  *   l - lambda pointer
  *   o - instruction offset
+ *   s - funcslot pointer (a lambda and a variable index)
  */
 
 OPCODE(nop, 'x')
@@ -38,9 +39,14 @@ OPCODE(popframe,'x')
 OPCODE(push_default,'x')
 OPCODE(jump_if_not_default,'o')
 
-#ifdef COMBO
-OPCODE(varpop,'n')
-OPCODE(fieldpop,'n')
+/* Superinstructions, produced only by program::optimize. */
+OPCODE(varpop,'n')      // varsave+pop
+OPCODE(fieldpop,'n')    // fieldsave+pop
+OPCODE(varcall,'n')     // varpush+popcall
+OPCODE(fieldcall,'n')   // fieldpush+popcall
+OPCODE(savefunc,'s')    // pushclosure+makefunc+varsave+pop
+OPCODE(tailcall,'x')    // popcall+ret
 
+#ifdef COMBO
 OPCODE(gejmp,'o')
 #endif
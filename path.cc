@@ -8,6 +8,8 @@
  * three-dimensional algorithms in path3.cc.
  *****/
 
+#include <algorithm>
+
 #include "path.h"
 #include "util.h"
 #include "angle.h"
@@ -474,6 +476,9 @@ static inline void derivative(pair& a, pair& b, pair& c,
 
 bbox path::bounds() const
 {
+  pathgeometry *g=Geometry();
+  bbox& box=g->box;
+  bbox& times=g->times;
   if(!box.empty) return box;
   
   if (empty()) {
@@ -486,7 +491,7 @@ bbox path::bounds() const
   times=bbox(len,len,len,len);
 
   for (Int i = 0; i < len; i++) {
-    addpoint(box,i);
+    addpoint(box,times,i);
     if(straight(i)) continue;
     
     pair a,b,c;
@@ -495,16 +500,16 @@ bbox path::bounds() const
     // Check x coordinate
     quadraticroots x(a.getx(),b.getx(),c.getx());
     if(x.distinct != quadraticroots::NONE && goodroot(x.t1))
-      addpoint(box,i+x.t1);
+      addpoint(box,times,i+x.t1);
     if(x.distinct == quadraticroots::TWO && goodroot(x.t2))
-      addpoint(box,i+x.t2);
+      addpoint(box,times,i+x.t2);
     
     // Check y coordinate
     quadraticroots y(a.gety(),b.gety(),c.gety());
     if(y.distinct != quadraticroots::NONE && goodroot(y.t1))
-      addpoint(box,i+y.t1);
+      addpoint(box,times,i+y.t1);
     if(y.distinct == quadraticroots::TWO && goodroot(y.t2))
-      addpoint(box,i+y.t2);
+      addpoint(box,times,i+y.t2);
   }
   return box;
 }
@@ -636,69 +641,56 @@ double path::cubiclength(Int i, double goal) const
   return -t;
 }
 
-double path::arclength() const 
+const mem::vector<double>& path::arclengths() const
 {
-  if (cached_length != -1) return cached_length;
-
-  double L=0.0;
-  for (Int i = 0; i < n-1; i++) {
-    L += cubiclength(i);
+  mem::vector<double>& lengths=Geometry()->lengths;
+  if(lengths.empty()) {
+    Int len=length();
+    lengths.reserve(len > 0 ? len+1 : 1);
+    double L=0.0;
+    lengths.push_back(L);
+    for(Int i=0; i < len; ++i)
+      lengths.push_back(L += cubiclength(i));
   }
-  if(cycles) L += cubiclength(n-1);
-  cached_length = L;
-  return cached_length;
+  return lengths;
+}
+
+double path::arclength() const
+{
+  return arclengths().back();
 }
 
 double path::arctime(double goal) const
 {
   if (cycles) {
-    if (goal == 0 || cached_length == 0) return 0;
+    if (goal == 0) return 0;
     if (goal < 0)  {
       const path &rp = this->reverse();
       double result = -rp.arctime(-goal);
       return result;
     }
-    if (cached_length > 0 && goal >= cached_length) {
-      Int loops = (Int)(goal / cached_length);
-      goal -= loops*cached_length;
-      return loops*n+arctime(goal);
-    }      
-  } else {
-    if (goal <= 0)
-      return 0;
-    if (cached_length > 0 && goal >= cached_length)
-      return n-1;
-  }
-    
-  double l,L=0;
-  for (Int i = 0; i < n-1; i++) {
-    l = cubiclength(i,goal);
-    if (l < 0)
-      return (-l+i);
-    else {
-      L += l;
-      goal -= l;
-      if (goal <= 0)
-        return i+1;
-    }
-  }
+  } else if (goal <= 0)
+    return 0;
+
+  const mem::vector<double>& lengths=arclengths();
+  double L=lengths.back();
   if (cycles) {
-    l = cubiclength(n-1,goal);
-    if (l < 0)
-      return -l+n-1;
-    if (cached_length > 0 && cached_length != L+l) {
-      reportError("arclength != length.\n"
-                  "path::arclength(double) must have broken semantics.\n"
-                  "Please report this error.");
+    if (L == 0) return 0;
+    if (goal >= L) {
+      Int loops = (Int)(goal / L);
+      goal -= loops*L;
+      return loops*n+arctime(goal);
     }
-    cached_length = L += l;
-    goal -= l;
-    return arctime(goal)+n;
-  }
-  else {
-    cached_length = L;
-    return length();
-  }
+  } else if (goal >= L)
+    return n-1;
+
+  // Find the first node at or beyond the goal, and then the time within the
+  // preceding segment.
+  Int i=std::lower_bound(lengths.begin(),lengths.end(),goal)-lengths.begin();
+  if (lengths[i] == goal) return i;
+  --i;
+  double l=cubiclength(i,goal-lengths[i]);
+  return l < 0 ? -l+i : i+1;
 }
 
 // }}}
@@ -1262,13 +1254,13 @@ bool checkcurve(const pair& z0, const pair& c0, const pair& c1,
   return false;
 }
 
+const Int undefinedwinding=Int_MAX % 2 ? Int_MAX : Int_MAX-1;
+
 // Return the winding number of the region bounded by the (cyclic) path
 // relative to the point z, or the largest odd integer if the point lies on
 // the path.
 Int path::windingnumber(const pair& z) const
 {
-  static const Int undefined=Int_MAX % 2 ? Int_MAX : Int_MAX-1;
-  
   if(!cycles)
     reportError("path is not cyclic");
   
@@ -1281,10 +1273,10 @@ Int path::windingnumber(const pair& z) const
   for(Int i=0; i < n; ++i)
     if(straight(i)) {
       if(checkstraight(point(i),point(i+1),z,count))
-        return undefined;
+        return undefinedwinding;
     } else
       if(checkcurve(point(i),postcontrol(i),precontrol(i+1),point(i+1),z,count,
-                    maxdepth)) return undefined;
+                    maxdepth)) return undefinedwinding;
   return count;
 }
 
@@ -75,24 +75,46 @@ extern const double sqrtFuzz;
 extern const double BigFuzz;
 extern const double fuzzFactor;
   
+// Quantities derived from the knots of a path: the arclength from the start
+// to each node, and the bounding box, with the times at which its extremes
+// are attained.
+struct pathgeometry : public gc {
+  mem::vector<double> lengths;
+  bbox box;
+  bbox times;
+};
+
 class path : public gc {
   bool cycles;  // If the path is closed in a loop
 
   Int n; // The number of knots
 
   mem::vector<solvedKnot> nodes;
-  mutable double cached_length; // Cache length since path is immutable.
-  
-  mutable bbox box;
-  mutable bbox times; // Times where minimum and maximum extents are attained.
+
+  // Since a path is immutable, its geometry is computed once, when first
+  // needed, and then shared with its copies.  It is reached through a cell
+  // that is allocated when the path is first copied or measured, so that
+  // copies made before the geometry is computed share it too.
+  mutable pathgeometry **geometry;
+
+  pathgeometry **Cell() const {
+    if(!geometry) geometry=new(UseGC) pathgeometry*(NULL);
+    return geometry;
+  }
+
+  pathgeometry *Geometry() const {
+    pathgeometry **cell=Cell();
+    if(!*cell) *cell=new pathgeometry;
+    return *cell;
+  }
 
 public:
   path()
-    : cycles(false), n(0), nodes(), cached_length(-1) {}
+    : cycles(false), n(0), nodes(), geometry(NULL) {}
 
   // Create a path of a single point
   path(pair z, bool = false)
-    : cycles(false), n(1), nodes(1), cached_length(-1)
+    : cycles(false), n(1), nodes(1), geometry(NULL)
   {
     nodes[0].pre = nodes[0].point = nodes[0].post = z;
     nodes[0].straight = false;
@@ -102,7 +124,7 @@ public:
   // methods such as the guide solver, but should probably not be used by a
   // user of the system unless he knows what he is doing.
   path(mem::vector<solvedKnot>& nodes, Int n, bool cycles = false)
-    : cycles(cycles), n(n), nodes(nodes), cached_length(-1)
+    : cycles(cycles), n(n), nodes(nodes), geometry(NULL)
   {
   }
 
@@ -113,7 +135,7 @@ public:
 
 public:
   path(solvedKnot n1, solvedKnot n2)
-    : cycles(false), n(2), nodes(2), cached_length(-1)
+    : cycles(false), n(2), nodes(2), geometry(NULL)
   {
     nodes[0] = n1;
     nodes[1] = n2;
@@ -123,13 +145,13 @@ public:
   
   // Copy constructor
   path(const path& p)
-    : cycles(p.cycles), n(p.n), nodes(p.nodes), cached_length(p.cached_length),
-      box(p.box)
+    : cycles(p.cycles), n(p.n), nodes(p.nodes), geometry(p.Cell())
   {}
 
   path unstraighten() const
   {
     path P=path(*this);
+    P.geometry=NULL;
     for(int i=0; i < n; ++i)
       P.nodes[i].straight=false;
     return P;
@@ -161,6 +183,7 @@ public:
   }
   
   mem::vector<solvedKnot>& Nodes() {
+    geometry=NULL;
     return nodes;
   }
   
@@ -322,17 +345,19 @@ public:
   pair mintimes() const {
     checkEmpty(n);
     bounds();
+    const bbox& times=Geometry()->times;
     return camp::pair(times.left,times.bottom);
   }
   
   pair maxtimes() const {
     checkEmpty(n);
     bounds();
+    const bbox& times=Geometry()->times;
     return camp::pair(times.right,times.top);
   }
   
   template<class T>
-  void addpoint(bbox& box, T i) const {
+  void addpoint(bbox& box, bbox& times, T i) const {
     box.addnonempty(point(i),times,(double) i);
   }
 
@@ -353,6 +378,10 @@ public:
   
   double cubiclength(Int i, double goal=-1) const;
   double arclength () const;
+
+  // The arclength from the start of the path to each node.
+  const mem::vector<double>& arclengths() const;
+
   double arctime (double l) const;
   double directiontime(const pair& z) const;
  
@@ -392,6 +421,7 @@ extern path nullpath;
 extern const unsigned maxdepth;
 extern const unsigned mindepth;
 extern const char *nopoints;
+extern const Int undefinedwinding; // The winding number on a path.
  
 bool intersect(double& S, double& T, path& p, path& q, double fuzz,
                unsigned depth=maxdepth);
@@ -402,6 +432,12 @@ bool intersections(double& s, double& t, std::vector<double>& S,
 void intersections(std::vector<double>& S, path& g,
                    const pair& p, const pair& q, double fuzz);
 
+// Return true if z lies on z0--z1 or on the curve z0..controls c0 and
+// c1..z1; otherwise add its contribution to the winding number count.
+bool checkstraight(const pair& z0, const pair& z1, const pair& z, Int& count);
+bool checkcurve(const pair& z0, const pair& c0, const pair& c1,
+                const pair& z1, const pair& z, Int& count, unsigned depth);
+
   
 // Concatenates two paths into a new one.
 path concat(const path& p1, const path& p2);
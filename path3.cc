@@ -6,6 +6,7 @@
  *****/
 
 #include <cfloat>
+#include <algorithm>
 
 #include "path3.h"
 #include "util.h"
@@ -274,6 +275,9 @@ static inline void derivative(triple& a, triple& b, triple& c,
 
 bbox3 path3::bounds() const
 {
+  path3geometry *g=Geometry();
+  bbox3& box=g->box;
+  bbox3& times=g->times;
   if(!box.empty) return box;
   
   if (empty()) {
@@ -286,7 +290,7 @@ bbox3 path3::bounds() const
   times=bbox3(len,len,len,len,len,len);
 
   for (Int i = 0; i < len; i++) {
-    addpoint(box,i);
+    addpoint(box,times,i);
     if(straight(i)) continue;
     
     triple a,b,c;
@@ -295,23 +299,23 @@ bbox3 path3::bounds() const
     // Check x coordinate
     quadraticroots x(a.getx(),b.getx(),c.getx());
     if(x.distinct != quadraticroots::NONE && goodroot(x.t1))
-      addpoint(box,i+x.t1);
+      addpoint(box,times,i+x.t1);
     if(x.distinct == quadraticroots::TWO && goodroot(x.t2))
-      addpoint(box,i+x.t2);
+      addpoint(box,times,i+x.t2);
     
     // Check y coordinate
     quadraticroots y(a.gety(),b.gety(),c.gety());
     if(y.distinct != quadraticroots::NONE && goodroot(y.t1))
-      addpoint(box,i+y.t1);
+      addpoint(box,times,i+y.t1);
     if(y.distinct == quadraticroots::TWO && goodroot(y.t2))
-      addpoint(box,i+y.t2);
+      addpoint(box,times,i+y.t2);
     
     // Check z coordinate
     quadraticroots z(a.getz(),b.getz(),c.getz());
     if(z.distinct != quadraticroots::NONE && goodroot(z.t1))
-      addpoint(box,i+z.t1);
+      addpoint(box,times,i+z.t1);
     if(z.distinct == quadraticroots::TWO && goodroot(z.t2))
-      addpoint(box,i+z.t2);
+      addpoint(box,times,i+z.t2);
   }
   return box;
 }
@@ -425,69 +429,56 @@ double path3::cubiclength(Int i, double goal) const
   return -t;
 }
 
-double path3::arclength() const
+const mem::vector<double>& path3::arclengths() const
 {
-  if (cached_length != -1) return cached_length;
-
-  double L=0.0;
-  for (Int i = 0; i < n-1; i++) {
-    L += cubiclength(i);
+  mem::vector<double>& lengths=Geometry()->lengths;
+  if(lengths.empty()) {
+    Int len=length();
+    lengths.reserve(len > 0 ? len+1 : 1);
+    double L=0.0;
+    lengths.push_back(L);
+    for(Int i=0; i < len; ++i)
+      lengths.push_back(L += cubiclength(i));
   }
-  if(cycles) L += cubiclength(n-1);
-  cached_length = L;
-  return cached_length;
+  return lengths;
+}
+
+double path3::arclength() const
+{
+  return arclengths().back();
 }
 
 double path3::arctime(double goal) const
 {
   if (cycles) {
-    if (goal == 0 || cached_length == 0) return 0;
+    if (goal == 0) return 0;
     if (goal < 0)  {
       const path3 &rp = this->reverse();
       double result = -rp.arctime(-goal);
       return result;
     }
-    if (cached_length > 0 && goal >= cached_length) {
-      Int loops = (Int)(goal / cached_length);
-      goal -= loops*cached_length;
-      return loops*n+arctime(goal);
-    }      
-  } else {
-    if (goal <= 0)
-      return 0;
-    if (cached_length > 0 && goal >= cached_length)
-      return n-1;
-  }
-    
-  double l,L=0;
-  for (Int i = 0; i < n-1; i++) {
-    l = cubiclength(i,goal);
-    if (l < 0)
-      return (-l+i);
-    else {
-      L += l;
-      goal -= l;
-      if (goal <= 0)
-        return i+1;
-    }
-  }
+  } else if (goal <= 0)
+    return 0;
+
+  const mem::vector<double>& lengths=arclengths();
+  double L=lengths.back();
   if (cycles) {
-    l = cubiclength(n-1,goal);
-    if (l < 0)
-      return -l+n-1;
-    if (cached_length > 0 && cached_length != L+l) {
-      reportError("arclength != length.\n"
-                  "path3::arclength(double) must have broken semantics.\n"
-                  "Please report this error.");
+    if (L == 0) return 0;
+    if (goal >= L) {
+      Int loops = (Int)(goal / L);
+      goal -= loops*L;
+      return loops*n+arctime(goal);
     }
-    cached_length = L += l;
-    goal -= l;
-    return arctime(goal)+n;
-  }
-  else {
-    cached_length = L;
-    return length();
-  }
+  } else if (goal >= L)
+    return n-1;
+
+  // Find the first node at or beyond the goal, and then the time within the
+  // preceding segment.
+  Int i=std::lower_bound(lengths.begin(),lengths.end(),goal)-lengths.begin();
+  if (lengths[i] == goal) return i;
+  --i;
+  double l=cubiclength(i,goal-lengths[i]);
+  return l < 0 ? -l+i : i+1;
 }
 
 // }}}
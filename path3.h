@@ -39,24 +39,46 @@ struct solvedKnot3 : public gc {
   }
 };
 
+// Quantities derived from the knots of a path3: the arclength from the start
+// to each node, and the bounding box, with the times at which its extremes
+// are attained.
+struct path3geometry : public gc {
+  mem::vector<double> lengths;
+  bbox3 box;
+  bbox3 times;
+};
+
 class path3 : public gc {
   bool cycles;  // If the path3 is closed in a loop
 
   Int n; // The number of knots
 
   mem::vector<solvedKnot3> nodes;
-  mutable double cached_length; // Cache length since path3 is immutable.
-  
-  mutable bbox3 box;
-  mutable bbox3 times; // Times where minimum and maximum extents are attained.
+
+  // Since a path3 is immutable, its geometry is computed once, when first
+  // needed, and then shared with its copies.  It is reached through a cell
+  // that is allocated when the path3 is first copied or measured, so that
+  // copies made before the geometry is computed share it too.
+  mutable path3geometry **geometry;
+
+  path3geometry **Cell() const {
+    if(!geometry) geometry=new(UseGC) path3geometry*(NULL);
+    return geometry;
+  }
+
+  path3geometry *Geometry() const {
+    path3geometry **cell=Cell();
+    if(!*cell) *cell=new path3geometry;
+    return *cell;
+  }
 
 public:
   path3()
-    : cycles(false), n(0), nodes(), cached_length(-1) {}
+    : cycles(false), n(0), nodes(), geometry(NULL) {}
 
   // Create a path3 of a single point
   path3(triple z, bool = false)
-    : cycles(false), n(1), nodes(1), cached_length(-1)
+    : cycles(false), n(1), nodes(1), geometry(NULL)
   {
     nodes[0].pre = nodes[0].point = nodes[0].post = z;
     nodes[0].straight = false;
@@ -66,7 +88,7 @@ public:
   // methods such as the guide solver, but should probably not be used by a
   // user of the system unless he knows what he is doing.
   path3(mem::vector<solvedKnot3>& nodes, Int n, bool cycles = false)
-    : cycles(cycles), n(n), nodes(nodes), cached_length(-1)
+    : cycles(cycles), n(n), nodes(nodes), geometry(NULL)
   {
   }
 
@@ -77,7 +99,7 @@ public:
 
 public:
   path3(solvedKnot3 n1, solvedKnot3 n2)
-    : cycles(false), n(2), nodes(2), cached_length(-1)
+    : cycles(false), n(2), nodes(2), geometry(NULL)
   {
     nodes[0] = n1;
     nodes[1] = n2;
@@ -87,13 +109,13 @@ public:
   
   // Copy constructor
   path3(const path3& p)
-    : cycles(p.cycles), n(p.n), nodes(p.nodes), cached_length(p.cached_length),
-      box(p.box)
+    : cycles(p.cycles), n(p.n), nodes(p.nodes), geometry(p.Cell())
   {}
 
   path3 unstraighten() const
   {
     path3 P=path3(*this);
+    P.geometry=NULL;
     for(int i=0; i < n; ++i)
       P.nodes[i].straight=false;
     return P;
@@ -125,6 +147,7 @@ public:
   }
   
   mem::vector<solvedKnot3>& Nodes() {
+    geometry=NULL;
     return nodes;
   }
   
@@ -287,22 +310,28 @@ public:
   triple mintimes() const {
     checkEmpty3(n);
     bounds();
+    const bbox3& times=Geometry()->times;
     return camp::triple(times.left,times.bottom,times.near);
   }
   
   triple maxtimes() const {
     checkEmpty3(n);
     bounds();
+    const bbox3& times=Geometry()->times;
     return camp::triple(times.right,times.top,times.far);
   }
   
   template<class T>
-  void addpoint(bbox3& box, T i) const {
+  void addpoint(bbox3& box, bbox3& times, T i) const {
     box.addnonempty(point(i),times,(double) i);
   }
 
   double cubiclength(Int i, double goal=-1) const;
   double arclength () const;
+
+  // The arclength from the start of the path3 to each node.
+  const mem::vector<double>& arclengths() const;
+
   double arctime (double l) const;
  
   triple max() const {
@@ -0,0 +1,522 @@
+/*****
+ * pathset.cc
+ *
+ * Queries over arrays of paths.
+ *****/
+
+#include <algorithm>
+#include <unistd.h>
+
+#include "pathset.h"
+#include "bvh.h"
+#include "errormsg.h"
+#include "settings.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+namespace camp {
+
+using settings::getSetting;
+
+namespace {
+
+typedef std::pair<double,double> times;
+
+void sortTimes(std::vector<double>& S, std::vector<double>& T)
+{
+  size_t n=S.size();
+  std::vector<times> V(n);
+  for(size_t i=0; i < n; ++i)
+    V[i]=times(S[i],T[i]);
+  std::stable_sort(V.begin(),V.end());
+  for(size_t i=0; i < n; ++i) {
+    S[i]=V[i].first;
+    T[i]=V[i].second;
+  }
+}
+
+template<class P>
+double defaultFuzz(const P& p)
+{
+  return BigFuzz*camp::max(length(p.max()),length(p.min()));
+}
+
+inline void coords(const pair& z, double *x)
+{
+  x[0]=z.getx();
+  x[1]=z.gety();
+}
+
+inline void coords(const triple& v, double *x)
+{
+  x[0]=v.getx();
+  x[1]=v.gety();
+  x[2]=v.getz();
+}
+
+template<class P, size_t D>
+void addSegments(mem::vector<bvhbox<D> >& boxes, mem::vector<size_t>& owner,
+                 const mem::vector<P *>& g, double fuzz)
+{
+  size_t n=g.size();
+  for(size_t i=0; i < n; ++i) {
+    const P& p=*g[i];
+    if(p.empty()) continue;
+    double e=fuzz < 0 ? defaultFuzz(p) : fuzz;
+    Int L=p.length();
+    for(Int k=0; k == 0 || k < L; ++k) {
+      // The control points bound the segment.
+      double x[4][D];
+      coords(p.point(k),x[0]);
+      coords(p.postcontrol(k),x[1]);
+      coords(p.precontrol(k+1),x[2]);
+      coords(p.point(k+1),x[3]);
+      bvhbox<D> b;
+      for(size_t d=0; d < D; ++d) {
+        double min=x[0][d], max=x[0][d];
+        for(size_t c=1; c < 4; ++c) {
+          if(x[c][d] < min) min=x[c][d];
+          if(x[c][d] > max) max=x[c][d];
+        }
+        b.min[d]=min-e;
+        b.max[d]=max+e;
+      }
+      boxes.push_back(b);
+      owner.push_back(i);
+    }
+  }
+}
+
+typedef std::pair<size_t,size_t> pathpair;
+
+// Collects the pairs of paths that own overlapping segments.
+struct candidates {
+  const mem::vector<size_t>& g,h;
+  bool self;
+  mem::vector<pathpair> pairs;
+
+  candidates(const mem::vector<size_t>& g, const mem::vector<size_t>& h,
+             bool self) : g(g), h(h), self(self) {}
+
+  void operator()(size_t i, size_t j) {
+    size_t a=g[i], b=h[j];
+    if(self) {
+      if(a == b) return;
+      if(a > b) std::swap(a,b);
+    }
+    pairs.push_back(pathpair(a,b));
+  }
+};
+
+// A number of tasks, taken in turn by the calling thread and by threads
+// created for the purpose, which are joined when the tasks are done.
+class tasks {
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+#endif
+  size_t count;
+  size_t next;
+  bool interrupted;
+
+  bool take(size_t& k) {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&lock);
+#endif
+    k=interrupted ? count : next++;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&lock);
+#endif
+    return k < count;
+  }
+
+  void work() {
+    size_t k;
+    while(take(k)) {
+      try {
+        task(k);
+      } catch(::interrupted&) {
+#ifdef HAVE_PTHREAD
+        pthread_mutex_lock(&lock);
+#endif
+        interrupted=true;
+#ifdef HAVE_PTHREAD
+        pthread_mutex_unlock(&lock);
+#endif
+        return;
+      }
+    }
+  }
+
+  static void *start(void *t) {
+    ((tasks *) t)->work();
+    return NULL;
+  }
+
+protected:
+  virtual void task(size_t k)=0;
+
+public:
+  tasks(size_t count) : count(count), next(0), interrupted(false) {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&lock,NULL);
+#endif
+  }
+
+  virtual ~tasks() {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy(&lock);
+#endif
+  }
+
+  // Runs the tasks in the calling thread and, if parallel and the threads
+  // setting allow it, in up to one further thread per processor, created
+  // for this call.
+  void run(bool parallel) {
+#ifdef HAVE_PTHREAD
+    size_t nthreads=1;
+    if(parallel && count > 1 && getSetting<bool>("threads")) {
+      long n=sysconf(_SC_NPROCESSORS_ONLN);
+      if(n > 1) nthreads=std::min((size_t) n,count);
+    }
+    mem::vector<pthread_t> threads;
+    for(size_t i=1; i < nthreads; ++i) {
+      pthread_t thread;
+      if(pthread_create(&thread,NULL,start,this) == 0)
+        threads.push_back(thread);
+    }
+#endif
+    work();
+#ifdef HAVE_PTHREAD
+    for(size_t i=0; i < threads.size(); ++i)
+      pthread_join(threads[i],NULL);
+#endif
+    if(interrupted) throw ::interrupted();
+  }
+};
+
+// The number of pairs of paths from which they are compared in parallel.
+const size_t parallelPairs=64;
+
+template<class P>
+struct intersectTasks : public tasks {
+  const mem::vector<P *>& g;
+  const mem::vector<P *>& h;
+  const mem::vector<pathpair>& pairs;
+  double fuzz;
+  mem::vector<std::vector<double> > S,T;
+
+  intersectTasks(const mem::vector<P *>& g, const mem::vector<P *>& h,
+                 const mem::vector<pathpair>& pairs, double fuzz)
+    : tasks(pairs.size()), g(g), h(h), pairs(pairs), fuzz(fuzz),
+      S(pairs.size()), T(pairs.size()) {}
+
+  void task(size_t k) {
+    intersectiontimes(S[k],T[k],*g[pairs[k].first],*h[pairs[k].second],fuzz);
+  }
+};
+
+template<class P, size_t D>
+void intersectSets(mem::vector<pathintersection>& result,
+                   const mem::vector<P *>& g, const mem::vector<P *> *h,
+                   double fuzz)
+{
+  const mem::vector<P *>& H=h ? *h : g;
+
+  // The bounds of each path are computed here, since the threads may not
+  // build the geometry that the paths share.
+  for(size_t i=0; i < g.size(); ++i)
+    g[i]->bounds();
+  if(h)
+    for(size_t i=0; i < h->size(); ++i)
+      (*h)[i]->bounds();
+
+  mem::vector<bvhbox<D> > gboxes,hboxes;
+  mem::vector<size_t> gowner,howner;
+  addSegments(gboxes,gowner,g,fuzz);
+  if(h)
+    addSegments(hboxes,howner,*h,fuzz);
+
+  bvh<D> gtree(gboxes);
+  candidates c(gowner,h ? howner : gowner,!h);
+  if(h) {
+    bvh<D> htree(hboxes);
+    gtree.pairs(htree,c);
+  } else
+    gtree.pairs(c);
+
+  std::sort(c.pairs.begin(),c.pairs.end());
+  c.pairs.erase(std::unique(c.pairs.begin(),c.pairs.end()),c.pairs.end());
+
+  intersectTasks<P> tasks(g,H,c.pairs,fuzz);
+  tasks.run(c.pairs.size() >= parallelPairs);
+
+  result.clear();
+  for(size_t k=0; k < c.pairs.size(); ++k) {
+    const std::vector<double>& S=tasks.S[k];
+    const std::vector<double>& T=tasks.T[k];
+    for(size_t m=0; m < S.size(); ++m) {
+      pathintersection x;
+      x.i=c.pairs[k].first;
+      x.j=c.pairs[k].second;
+      x.s=S[m];
+      x.t=T[m];
+      result.push_back(x);
+    }
+  }
+}
+
+
+// The region bounded by an array of cyclic paths, with the segments indexed
+// by a grid of cells for locating many points.  A segment can contribute to
+// the winding number of its path relative to a point only if the point lies
+// within the bounds of the path, within the vertical extent of the control
+// points of the segment, and not to their right, so it is listed only in
+// the cells that meet that rectangle.
+class region {
+  struct segment {
+    size_t path;
+    Int i;
+    double xmax;
+  };
+
+  struct rectangle {
+    double left,bottom,right,top;
+  };
+
+  const mem::vector<path *>& g;
+  mem::vector<bbox> bounds;
+  mem::vector<segment> segments;
+  mem::vector<size_t> start; // Cell k holds segments start[k...start[k+1]-1].
+  double left,bottom,right,top,width,height;
+  size_t nx,ny;
+
+  static size_t cell(double x, double origin, double size, size_t n) {
+    size_t k=size > 0 ? (size_t) ((x-origin)/size) : 0;
+    return k < n ? k : n-1;
+  }
+
+  struct rightmost {
+    bool operator()(const segment& a, const segment& b) const {
+      return a.xmax > b.xmax;
+    }
+  };
+
+public:
+  region(const mem::vector<path *>& g) : g(g), bounds(g.size()),
+                                         left(0.0), bottom(0.0), right(0.0),
+                                         top(0.0), width(0.0), height(0.0),
+                                         nx(0), ny(0) {
+    size_t n=g.size();
+    for(size_t j=0; j < n; ++j)
+      if(!g[j]->cyclic())
+        reportError("path is not cyclic");
+
+    mem::vector<segment> all;
+    mem::vector<rectangle> rects;
+    bbox domain;
+    for(size_t j=0; j < n; ++j) {
+      const path& p=*g[j];
+      const bbox& B=bounds[j]=p.bounds();
+      domain += B;
+      for(Int i=0; i < p.length(); ++i) {
+        bbox b(p.point(i));
+        b.addnonempty(p.postcontrol(i));
+        b.addnonempty(p.precontrol(i+1));
+        b.addnonempty(p.point(i+1));
+        segment s={j,i,b.right};
+        rectangle r={B.left,std::max(b.bottom,B.bottom),
+                     std::min(b.right,B.right),std::min(b.top,B.top)};
+        all.push_back(s);
+        rects.push_back(r);
+      }
+    }
+
+    size_t m=all.size();
+    if(m == 0) return;
+    left=domain.left;
+    bottom=domain.bottom;
+    right=domain.right;
+    top=domain.top;
+
+    // Halve the number of columns or rows of the grid, whichever the
+    // segments span more of, until each segment is listed at most a few
+    // times on average.
+    mem::vector<size_t> x0(m),x1(m),y0(m),y1(m);
+    nx=ny=(size_t) sqrt((double) m)+1;
+    for(;;) {
+      width=(right-left)/nx;
+      height=(top-bottom)/ny;
+      size_t entries=0,columns=0,rows=0;
+      for(size_t k=0; k < m; ++k) {
+        const rectangle& r=rects[k];
+        x0[k]=cell(r.left,left,width,nx);
+        x1[k]=cell(r.right,left,width,nx);
+        y0[k]=cell(r.bottom,bottom,height,ny);
+        y1[k]=cell(r.top,bottom,height,ny);
+        columns += x1[k]-x0[k];
+        rows += y1[k]-y0[k];
+        entries += (x1[k]-x0[k]+1)*(y1[k]-y0[k]+1);
+      }
+      if((nx == 1 && ny == 1) || entries <= 8*m) break;
+      if(ny == 1 || (nx > 1 && columns >= rows)) nx=(nx+1)/2;
+      else ny=(ny+1)/2;
+    }
+
+    size_t ncells=nx*ny;
+    start.assign(ncells+1,0);
+    for(size_t k=0; k < m; ++k)
+      for(size_t v=y0[k]; v <= y1[k]; ++v)
+        for(size_t u=x0[k]; u <= x1[k]; ++u)
+          ++start[v*nx+u+1];
+    for(size_t l=0; l < ncells; ++l)
+      start[l+1] += start[l];
+    segments.resize(start[ncells]);
+    mem::vector<size_t> fill(ncells);
+    for(size_t l=0; l < ncells; ++l)
+      fill[l]=start[l];
+    for(size_t k=0; k < m; ++k)
+      for(size_t v=y0[k]; v <= y1[k]; ++v)
+        for(size_t u=x0[k]; u <= x1[k]; ++u)
+          segments[fill[v*nx+u]++]=all[k];
+    for(size_t l=0; l < ncells; ++l)
+      std::sort(segments.begin()+start[l],segments.begin()+start[l+1],
+                rightmost());
+  }
+
+  // Space for the winding numbers of the paths about one point.
+  struct scratch {
+    mem::vector<Int> count;
+    mem::vector<char> seen;
+    mem::vector<size_t> touched;
+    scratch(size_t n) : count(n), seen(n) {}
+  };
+
+  // Returns the sum of the winding numbers of the paths relative to z, as
+  // computed by path::windingnumber.
+  Int windingnumber(const pair& z, scratch& w) const {
+    double x=z.getx(), y=z.gety();
+    if(nx == 0 || x < left || x > right || y < bottom || y > top) return 0;
+
+    size_t l=cell(y,bottom,height,ny)*nx+cell(x,left,width,nx);
+    for(size_t k=start[l]; k < start[l+1]; ++k) {
+      const segment& s=segments[k];
+      if(s.xmax < x) break;
+      size_t j=s.path;
+      const bbox& b=bounds[j];
+      if(x < b.left || x > b.right || y < b.bottom || y > b.top ||
+         w.count[j] == undefinedwinding) continue;
+      const path& p=*g[j];
+      Int i=s.i;
+      Int c=0;
+      bool on=p.straight(i) ? checkstraight(p.point(i),p.point(i+1),z,c) :
+        checkcurve(p.point(i),p.postcontrol(i),p.precontrol(i+1),
+                   p.point(i+1),z,c,maxdepth);
+      if(on || c != 0) {
+        if(!w.seen[j]) {
+          w.seen[j]=true;
+          w.touched.push_back(j);
+        }
+        w.count[j]=on ? undefinedwinding : w.count[j]+c;
+      }
+    }
+
+    Int sum=0;
+    for(size_t k=0; k < w.touched.size(); ++k) {
+      size_t j=w.touched[k];
+      sum += w.count[j];
+      w.count[j]=0;
+      w.seen[j]=false;
+    }
+    w.touched.clear();
+    return sum;
+  }
+
+  size_t size() const {return g.size();}
+};
+
+// The number of points located together by one thread.
+const size_t pointBlock=4096;
+
+struct windingTasks : public tasks {
+  const region& R;
+  const mem::vector<pair>& z;
+  mem::vector<Int>& result;
+
+  windingTasks(const region& R, const mem::vector<pair>& z,
+               mem::vector<Int>& result)
+    : tasks((z.size()+pointBlock-1)/pointBlock), R(R), z(z), result(result) {}
+
+  void task(size_t k) {
+    region::scratch w(R.size());
+    size_t end=std::min(z.size(),(k+1)*pointBlock);
+    for(size_t i=k*pointBlock; i < end; ++i)
+      result[i]=R.windingnumber(z[i],w);
+  }
+};
+}
+
+void intersectiontimes(std::vector<double>& S, std::vector<double>& T,
+                       path& p, path& q, double fuzz)
+{
+  bool exact=fuzz <= 0.0;
+  if(fuzz < 0.0)
+    fuzz=camp::max(defaultFuzz(p),defaultFuzz(q));
+  double s,t;
+  intersections(s,t,S,T,p,q,fuzz,false,true);
+  if(S.size() == 0 && !exact) {
+    if(intersections(s,t,S,T,p,q,fuzz,true,false)) {
+      S.push_back(s);
+      T.push_back(t);
+    }
+    return;
+  }
+  sortTimes(S,T);
+}
+
+void intersectiontimes(std::vector<double>& S, std::vector<double>& T,
+                       path3& p, path3& q, double fuzz)
+{
+  bool exact=fuzz <= 0.0;
+  if(fuzz < 0.0)
+    fuzz=camp::max(defaultFuzz(p),defaultFuzz(q));
+  bool single=!exact;
+
+  double s,t;
+  if(!intersections(s,t,S,T,p,q,fuzz,single,exact)) {
+    S.clear();
+    T.clear();
+    return;
+  }
+  if(single) {
+    S.assign(1,s);
+    T.assign(1,t);
+  } else sortTimes(S,T);
+}
+
+void intersections(mem::vector<pathintersection>& result,
+                   const mem::vector<path *>& g,
+                   const mem::vector<path *> *h, double fuzz)
+{
+  intersectSets<path,2>(result,g,h,fuzz);
+}
+
+void intersections(mem::vector<pathintersection>& result,
+                   const mem::vector<path3 *>& g,
+                   const mem::vector<path3 *> *h, double fuzz)
+{
+  intersectSets<path3,3>(result,g,h,fuzz);
+}
+
+void windingnumbers(mem::vector<Int>& result, const mem::vector<path *>& g,
+                    const mem::vector<pair>& z)
+{
+  result.resize(z.size());
+  if(z.empty()) return;
+  region R(g);
+  windingTasks tasks(R,z,result);
+  tasks.run(true);
+}
+
+}
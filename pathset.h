@@ -0,0 +1,84 @@
+/*****
+ * pathset.h
+ *
+ * Queries over arrays of paths.
+ *****/
+
+#ifndef PATHSET_H
+#define PATHSET_H
+
+#include "path.h"
+#include "path3.h"
+#include "array.h"
+
+namespace camp {
+
+// Paths i and j meet at times s and t.
+struct pathintersection {
+  size_t i,j;
+  double s,t;
+};
+
+// Finds the intersection times of p and q, sorted, as the builtin
+// intersections(path, path, real) does: a negative fuzz chooses one in
+// proportion to the size of the paths, and a positive one, when no exact
+// intersections are found, returns the first intersection within fuzz.
+void intersectiontimes(std::vector<double>& S, std::vector<double>& T,
+                       path& p, path& q, double fuzz);
+void intersectiontimes(std::vector<double>& S, std::vector<double>& T,
+                       path3& p, path3& q, double fuzz);
+
+// Finds the intersections of each pair of paths in g, with i < j, or, if h
+// is given, of each path g[i] with each path h[j], in order of i, j, s, and
+// t.  Only the pairs of paths with overlapping segment bounding boxes are
+// compared, as found with a bounding volume hierarchy, in parallel threads
+// if there are many.
+void intersections(mem::vector<pathintersection>& result,
+                   const mem::vector<path *>& g,
+                   const mem::vector<path *> *h, double fuzz);
+void intersections(mem::vector<pathintersection>& result,
+                   const mem::vector<path3 *>& g,
+                   const mem::vector<path3 *> *h, double fuzz);
+
+// Finds the sum of the winding numbers of the cyclic paths g relative to
+// each point z[i], as path::windingnumber would.  Only the segments that
+// may contribute are examined, using an index built once for all of the
+// points, which are located in parallel threads.
+void windingnumbers(mem::vector<Int>& result, const mem::vector<path *>& g,
+                    const mem::vector<pair>& z);
+
+// Returns the intersections of the arrays of paths g and h, or of g with
+// itself if h is NULL, as an array of {i,j,s,t}.
+template<class P>
+vm::array *intersectionArray(vm::array *g, vm::array *h, double fuzz)
+{
+  size_t n=vm::checkArray(g);
+  mem::vector<P *> G(n);
+  for(size_t i=0; i < n; ++i)
+    G[i]=vm::read<P *>(g,i);
+  mem::vector<P *> H;
+  if(h) {
+    size_t m=vm::checkArray(h);
+    H.resize(m);
+    for(size_t j=0; j < m; ++j)
+      H[j]=vm::read<P *>(h,j);
+  }
+
+  mem::vector<pathintersection> result;
+  intersections(result,G,h ? &H : NULL,fuzz);
+  size_t count=result.size();
+  vm::array *V=new vm::array(count);
+  for(size_t k=0; k < count; ++k) {
+    vm::array *Vk=new vm::array(4);
+    (*V)[k]=Vk;
+    (*Vk)[0]=(double) result[k].i;
+    (*Vk)[1]=(double) result[k].j;
+    (*Vk)[2]=result[k].s;
+    (*Vk)[3]=result[k].t;
+  }
+  return V;
+}
+
+}
+
+#endif
@@ -0,0 +1,685 @@
+/*****
+ * pdffile.cc
+ *
+ * Writes a picture directly as a single-page PDF file.
+ *****/
+
+#include <cmath>
+#include <zlib.h>
+
+#include "pdffile.h"
+#include "settings.h"
+#include "errormsg.h"
+
+using vm::array;
+using vm::read;
+
+namespace camp {
+
+namespace {
+// The first object number of pdffile::objects, after the catalog, page
+// tree, and page.
+const size_t firstObject=4;
+
+// PDF has no exponential notation.
+void numbers(std::ostream& s)
+{
+  s.setf(std::ios::boolalpha);
+  s.setf(std::ios::fixed,std::ios::floatfield);
+  s.precision(5);
+}
+
+// Stores the color components of p in c, returning how many there are.
+size_t components(const pen& p, double *c)
+{
+  if(p.cmyk()) {
+    c[0]=p.cyan(); c[1]=p.magenta(); c[2]=p.yellow(); c[3]=p.black();
+    return 4;
+  }
+  if(p.rgb()) {
+    c[0]=p.red(); c[1]=p.green(); c[2]=p.blue();
+    return 3;
+  }
+  if(p.grayscale()) {
+    c[0]=p.gray();
+    return 1;
+  }
+  return 0;
+}
+
+void writecomponents(std::ostream& out, const pen& p)
+{
+  double c[4];
+  size_t n=components(p,c);
+  for(size_t i=0; i < n; ++i)
+    out << (i > 0 ? " " : "") << c[i];
+}
+
+bool samecolor(const pen& p, const pen& q)
+{
+  if(p.colorspace() != q.colorspace()) return false;
+  double c[4],d[4];
+  size_t n=components(p,c);
+  components(q,d);
+  for(size_t i=0; i < n; ++i)
+    if(c[i] != d[i]) return false;
+  return true;
+}
+
+void put(string& s, unsigned long n, size_t bytes)
+{
+  for(size_t i=bytes; i > 0;)
+    s += (char) (n >> (8*--i));
+}
+
+void promote(pen& p, ColorSpace colorspace)
+{
+  p.convert();
+  if(!p.promote(colorspace))
+    reportError(inconsistent);
+}
+}
+
+pdffile::pdffile(const string& filename)
+  : psfile(filename,true), nshadings(0), nimages(0),
+    imagecolorspace(DEFCOLOR), groupcolorspace(DEFCOLOR), pathT(identity)
+{
+  pdf=true;
+  file=out;
+  out=&content;
+  numbers(content);
+  numbers(extgstates);
+  numbers(shadings);
+  numbers(xobjects);
+}
+
+pdffile::~pdffile()
+{
+  if(out == &content) out=file;
+}
+
+size_t pdffile::addObject(const string& s)
+{
+  objects.push_back(s);
+  return firstObject+objects.size()-1;
+}
+
+size_t pdffile::addStream(const string& dict, const unsigned char *data,
+                          size_t size)
+{
+  uLongf compressedSize=compressBound(size);
+  Bytef *compressed=new Bytef[compressedSize];
+  if(compress(compressed,&compressedSize,data,size) != Z_OK)
+    reportError("PDF stream compression failed");
+
+  ostringstream buf;
+  buf << "<< " << dict << (dict.empty() ? "" : " ") << "/Filter /FlateDecode /Length " << compressedSize
+      << " >>" << newl << "stream" << newl;
+  string s=buf.str();
+  s.append((const char *) compressed,compressedSize);
+  s += "\nendstream";
+  delete[] compressed;
+  return addObject(s);
+}
+
+size_t pdffile::copyObject(const pdfdocument *doc, size_t n)
+{
+  source key(doc,n);
+  mem::map<source,size_t>::iterator p=copied.find(key);
+  if(p != copied.end()) return p->second;
+
+  // The number is assigned first, in case the object refers back to itself.
+  size_t m=addObject("");
+  copied[key]=m;
+
+  string value,stream;
+  if(!doc->object(n,value,stream))
+    value="null";
+  string s=copyReferences(doc,value);
+  if(!stream.empty())
+    s += "\nstream\n"+stream+"\nendstream";
+  objects[m-firstObject]=s;
+  return m;
+}
+
+string pdffile::copyReferences(const pdfdocument *doc, const string& s)
+{
+  mem::vector<pdfreference> refs;
+  pdfdocument::references(s,refs);
+  ostringstream buf;
+  size_t pos=0;
+  for(size_t i=0; i < refs.size(); ++i) {
+    buf << s.substr(pos,refs[i].start-pos) << copyObject(doc,refs[i].object)
+        << " 0 R";
+    pos=refs[i].end;
+  }
+  buf << s.substr(pos);
+  return buf.str();
+}
+
+size_t pdffile::form(const pdfdocument *doc, size_t page)
+{
+  source key(doc,page);
+  mem::map<source,size_t>::iterator p=forms.find(key);
+  if(p != forms.end()) return p->second;
+
+  // The content stream of the page becomes that of the form, with the
+  // resources of the page.
+  string dict,stream,contents;
+  if(!doc->object(page,dict,stream))
+    reportError("Cannot read PDF page");
+  string value=doc->lookup(dict,"/Contents",false);
+  mem::vector<pdfreference> refs;
+  pdfdocument::references(value,refs);
+  if(refs.size() != 1 || !doc->object(refs[0].object,contents,stream) ||
+     contents.compare(0,2,"<<") != 0)
+    reportError("Cannot read PDF page contents");
+
+  ostringstream buf;
+  numbers(buf);
+  buf << "<< /Type /XObject /Subtype /Form /BBox "
+      << doc->lookup(dict,"/MediaBox") << newl
+      << "/Resources " << copyReferences(doc,doc->lookup(dict,"/Resources",
+                                                          false))
+      << newl << copyReferences(doc,contents.substr(2)) << newl
+      << "stream" << newl << stream << newl << "endstream";
+  size_t n=forms.size();
+  forms[key]=n;
+  xobjects << "/Fm" << n << " " << addObject(buf.str()) << " 0 R" << newl;
+  return n;
+}
+
+void pdffile::place(const pdfdocument *doc, size_t page, const transform& t)
+{
+  size_t n=form(doc,page);
+  gsave();
+  // Like TeX, start with opaque black.
+  setopacity(pen());
+  *out << "0 g 0 G" << newl;
+  concat(t);
+  *out << "/Fm" << n << " Do" << newl;
+  grestore();
+}
+
+void pdffile::prologue(const bbox& b)
+{
+  // Like Ghostscript's EPSCrop, the page is the bounding box rounded outward
+  // with its lower-left corner at the origin.
+  box=b.LowRes();
+  translate(pair(-box.left,-box.bottom));
+}
+
+void pdffile::epilogue()
+{
+  string page=content.str();
+  out=file;
+  size_t contents=objects.size()+firstObject;
+  addStream("",(const unsigned char *) page.data(),page.size());
+
+  ostringstream info;
+  info << "<< /Creator (" << settings::PROGRAM << " " << settings::VERSION
+       << REVISION << ") >>";
+  size_t infoObject=addObject(info.str());
+
+  ostringstream doc;
+  numbers(doc);
+  mem::vector<size_t> offsets;
+  doc << "%PDF-1.4" << newl << "%\342\343\317\323" << newl;
+
+  offsets.push_back(doc.tellp());
+  doc << "1 0 obj" << newl << "<< /Type /Catalog /Pages 2 0 R >>" << newl
+      << "endobj" << newl;
+
+  offsets.push_back(doc.tellp());
+  doc << "2 0 obj" << newl << "<< /Type /Pages /Kids [3 0 R] /Count 1 >>"
+      << newl << "endobj" << newl;
+
+  offsets.push_back(doc.tellp());
+  doc << "3 0 obj" << newl
+      << "<< /Type /Page /Parent 2 0 R" << newl
+      << "/MediaBox [0 0 " << box.right-box.left << " "
+      << box.top-box.bottom << "]" << newl
+      << "/Resources <<";
+  if(!extgstates.str().empty())
+    doc << newl << "/ExtGState <<" << newl << extgstates.str() << ">>";
+  if(!shadings.str().empty())
+    doc << newl << "/Shading <<" << newl << shadings.str() << ">>";
+  if(!xobjects.str().empty())
+    doc << newl << "/XObject <<" << newl << xobjects.str() << ">>";
+  doc << " >>" << newl;
+  if(transparency) {
+    ColorSpace colorspace=groupcolorspace >= GRAYSCALE ? groupcolorspace :
+      RGB;
+    doc << "/Group << /S /Transparency /CS /Device"
+        << ColorDeviceSuffix[colorspace] << " >>" << newl;
+  }
+  doc << "/Contents " << contents << " 0 R >>" << newl << "endobj" << newl;
+
+  for(size_t i=0; i < objects.size(); ++i) {
+    offsets.push_back(doc.tellp());
+    doc << i+firstObject << " 0 obj" << newl << objects[i] << newl
+        << "endobj" << newl;
+  }
+
+  size_t xref=doc.tellp();
+  size_t size=offsets.size()+1;
+  doc << "xref" << newl << "0 " << size << newl
+      << "0000000000 65535 f " << newl;
+  char prev=doc.fill('0');
+  for(size_t i=0; i < offsets.size(); ++i)
+    doc << std::setw(10) << offsets[i] << " 00000 n " << newl;
+  doc.fill(prev);
+  doc << "trailer" << newl
+      << "<< /Size " << size << " /Root 1 0 R /Info " << infoObject
+      << " 0 R >>" << newl
+      << "startxref" << newl << xref << newl
+      << "%%EOF" << newl;
+
+  string s=doc.str();
+  file->write(s.data(),s.size());
+}
+
+void pdffile::addSegment(char op, pair z0, pair z1, pair z2)
+{
+  segment s;
+  s.op=op;
+  s.z[0]=z0;
+  s.z[1]=z1;
+  s.z[2]=z2;
+  segments.push_back(s);
+}
+
+// Writes the pending path in the current coordinates, returning false if
+// a singular transform since its construction has collapsed it, in which
+// case there is nothing to paint.
+bool pdffile::writepath()
+{
+  if(!pathT.invertible()) {
+    newpath();
+    return false;
+  }
+  transform T=inverse(pathT);
+  for(size_t i=0; i < segments.size(); ++i) {
+    segment& s=segments[i];
+    switch(s.op) {
+      case 'm':
+        psfile::moveto(T*s.z[0]);
+        break;
+      case 'l':
+        psfile::lineto(T*s.z[0]);
+        break;
+      case 'c':
+        psfile::curveto(T*s.z[0],T*s.z[1],T*s.z[2]);
+        break;
+      default:
+        psfile::closepath();
+        break;
+    }
+  }
+  newpath();
+  return true;
+}
+
+void pdffile::newpath()
+{
+  segments.clear();
+  pathT=identity;
+}
+
+void pdffile::stroke(const pen &p, bool dot)
+{
+  if(writepath())
+    psfile::stroke(p,dot);
+}
+
+void pdffile::fill(const pen &p)
+{
+  if(writepath())
+    psfile::fill(p);
+}
+
+void pdffile::endclip(const pen &p)
+{
+  // A shading repeats the clip of its drawShade.
+  if(segments.empty()) return;
+  if(writepath())
+    psfile::endclip(p);
+  else
+    // A collapsed clipping path leaves nothing visible.
+    *out << "0 0 m W n" << newl;
+}
+
+void pdffile::translate(pair z)
+{
+  psfile::translate(z);
+  if(!segments.empty()) pathT=pathT*shift(z);
+}
+
+void pdffile::concat(transform t)
+{
+  psfile::concat(t);
+  if(!segments.empty()) pathT=pathT*t;
+}
+
+void pdffile::setopacity(const pen& p)
+{
+  if(p.blend() != lastpen.blend() || p.opacity() != lastpen.opacity()) {
+    ostringstream buf;
+    numbers(buf);
+    buf << "/CA " << p.opacity() << " /ca " << p.opacity() << " /BM /"
+        << p.blend();
+    string key=buf.str();
+    mem::map<string,size_t>::iterator q=gstates.find(key);
+    size_t n;
+    if(q == gstates.end()) {
+      n=gstates.size();
+      gstates[key]=n;
+      extgstates << "/GS" << n << " << " << key << " >>" << newl;
+    } else n=q->second;
+    *out << "/GS" << n << " gs" << newl;
+    transparency=true;
+  }
+
+  lastpen.settransparency(p);
+}
+
+void pdffile::writecolor(const pen& p)
+{
+  // Set both the stroking and nonstroking colors.
+  usecolorspace(p.colorspace());
+  if(p.cmyk()) {
+    writecomponents(*out,p);
+    *out << " K ";
+    writecomponents(*out,p);
+    *out << " k" << newl;
+  } else if(p.rgb()) {
+    writecomponents(*out,p);
+    *out << " RG ";
+    writecomponents(*out,p);
+    *out << " rg" << newl;
+  } else if(p.grayscale()) {
+    writecomponents(*out,p);
+    *out << " G ";
+    writecomponents(*out,p);
+    *out << " g" << newl;
+  }
+}
+
+void pdffile::setpen(pen p)
+{
+  p.convert();
+
+  setopacity(p);
+
+  if(!p.fillpattern().empty())
+    reportError("PDF output does not support fill patterns");
+
+  if(!samecolor(p,lastpen))
+    writecolor(p);
+
+  if(p.width() != lastpen.width())
+    *out << p.width() << " w" << newl;
+
+  if(p.cap() != lastpen.cap())
+    *out << p.cap() << " J" << newl;
+
+  if(p.join() != lastpen.join())
+    *out << p.join() << " j" << newl;
+
+  if(p.miter() != lastpen.miter())
+    *out << p.miter() << " M" << newl;
+
+  const LineType *linetype=p.linetype();
+  const LineType *lastlinetype=lastpen.linetype();
+
+  if(!(linetype->pattern == lastlinetype->pattern) ||
+     linetype->offset != lastlinetype->offset)
+    *out << linetype->pattern << " " << linetype->offset << " d" << newl;
+
+  lastpen=p;
+}
+
+void pdffile::imageheader(size_t, size_t, ColorSpace colorspace)
+{
+  imagecolorspace=colorspace;
+  usecolorspace(colorspace);
+}
+
+void pdffile::outImage(bool antialias, size_t width, size_t height,
+                       size_t ncomponents)
+{
+  if(antialias) dealias(buffer,width,height,ncomponents);
+
+  ostringstream dict;
+  dict << "/Type /XObject /Subtype /Image /Width " << width
+       << " /Height " << height << " /ColorSpace /Device"
+       << ColorDeviceSuffix[imagecolorspace] << " /BitsPerComponent 8";
+  size_t n=addStream(dict.str(),buffer,count);
+  xobjects << "/Im" << nimages << " " << n << " 0 R" << newl;
+
+  // The first row of a PostScript image is at the bottom of the unit
+  // square; in PDF it is at the top.
+  *out << "q 1 0 0 -1 0 1 cm /Im" << nimages << " Do Q" << newl;
+  ++nimages;
+}
+
+void pdffile::shade(size_t object)
+{
+  shadings << "/Sh" << nshadings << " " << object << " 0 R" << newl;
+  *out << "/Sh" << nshadings << " sh" << newl;
+  ++nshadings;
+}
+
+void pdffile::latticeshade(const array& a, const transform& t)
+{
+  size_t n=a.size();
+  if(n == 0) return;
+
+  array *a0=read<array *>(a,0);
+  size_t m=a0->size();
+  setfirstopacity(*a0);
+
+  ColorSpace colorspace=maxcolorspace2(a);
+  checkColorSpace(colorspace);
+
+  size_t ncomponents=ColorComponents[colorspace];
+
+  beginImage(ncomponents*m*n);
+  for(size_t i=n; i > 0;) {
+    array *ai=read<array *>(a,--i);
+    checkArray(ai);
+    if(ai->size() != m) reportError(rectangular);
+    for(size_t j=0; j < m; j++) {
+      pen *p=read<pen *>(ai,j);
+      promote(*p,colorspace);
+      write(p,ncomponents);
+    }
+  }
+
+  ostringstream dict;
+  dict << "/FunctionType 0 /Order 1 /Domain [0 1 0 1] /Range [";
+  for(size_t i=0; i < ncomponents; ++i)
+    dict << "0 1 ";
+  dict << "] /BitsPerSample 8 /Size [" << m << " " << n << "]";
+  usecolorspace(colorspace);
+  size_t function=addStream(dict.str(),buffer,count);
+  delete[] buffer;
+
+  ostringstream shading;
+  numbers(shading);
+  shading << "<< /ShadingType 1 /ColorSpace /Device"
+          << ColorDeviceSuffix[colorspace]
+          << " /Matrix [" << t.getxx() << " " << t.getyx() << " "
+          << t.getxy() << " " << t.getyy() << " " << t.getx() << " "
+          << t.gety() << "] /Function " << function << " 0 R >>";
+  shade(addObject(shading.str()));
+}
+
+void pdffile::gradientshade(bool axial, ColorSpace colorspace,
+                            const pen& pena, const pair& a, double ra,
+                            bool extenda, const pen& penb, const pair& b,
+                            double rb, bool extendb)
+{
+  endclip(pena);
+
+  setopacity(pena);
+  checkColorSpace(colorspace);
+  usecolorspace(colorspace);
+
+  ostringstream shading;
+  numbers(shading);
+  shading << "<< /ShadingType " << (axial ? "2" : "3")
+          << " /ColorSpace /Device" << ColorDeviceSuffix[colorspace]
+          << " /Coords [" << a.getx() << " " << a.gety();
+  if(!axial) shading << " " << ra;
+  shading << " " << b.getx() << " " << b.gety();
+  if(!axial) shading << " " << rb;
+  shading << "] /Extend [" << extenda << " " << extendb << "]" << newl
+          << "/Function << /FunctionType 2 /Domain [0 1] /C0 [";
+  writecomponents(shading,pena);
+  shading << "] /C1 [";
+  writecomponents(shading,penb);
+  shading << "] /N 1 >> >>";
+  shade(addObject(shading.str()));
+}
+
+// Encodes a free-form triangle (type 4) or tensor-product patch (type 7)
+// mesh, each vertex or patch starting with one of flags, followed by its
+// share of the coordinates z and colors pens.
+void pdffile::meshshade(Int type, ColorSpace colorspace,
+                        const mem::vector<unsigned char>& flags,
+                        const mem::vector<pair>& z,
+                        const mem::vector<pen>& pens)
+{
+  size_t n=flags.size();
+  if(n == 0) return;
+  size_t nz=z.size()/n;
+  size_t npens=pens.size()/n;
+  usecolorspace(colorspace);
+
+  bbox b;
+  for(size_t i=0; i < z.size(); ++i)
+    b += z[i];
+  if(b.right == b.left) b.right += 1.0;
+  if(b.top == b.bottom) b.top += 1.0;
+  double sx=4294967295.0/(b.right-b.left);
+  double sy=4294967295.0/(b.top-b.bottom);
+
+  string data;
+  for(size_t i=0; i < n; ++i) {
+    data += (char) flags[i];
+    for(size_t j=i*nz; j < (i+1)*nz; ++j) {
+      put(data,(unsigned long) floor((z[j].getx()-b.left)*sx+0.5),4);
+      put(data,(unsigned long) floor((z[j].gety()-b.bottom)*sy+0.5),4);
+    }
+    for(size_t j=i*npens; j < (i+1)*npens; ++j) {
+      double c[4];
+      size_t nc=components(pens[j],c);
+      for(size_t k=0; k < nc; ++k)
+        put(data,(unsigned long) floor(c[k]*65535.0+0.5),2);
+    }
+  }
+
+  ostringstream dict;
+  numbers(dict);
+  dict << "/ShadingType " << type << " /ColorSpace /Device"
+       << ColorDeviceSuffix[colorspace]
+       << " /BitsPerCoordinate 32 /BitsPerComponent 16 /BitsPerFlag 8"
+       << " /Decode [" << b.left << " " << b.right << " " << b.bottom << " "
+       << b.top;
+  for(size_t i=0; i < ColorComponents[colorspace]; ++i)
+    dict << " 0 1";
+  dict << "]";
+  shade(addStream(dict.str(),(const unsigned char *) data.data(),
+                  data.size()));
+}
+
+void pdffile::gouraudshade(const pen& pentype, const array& pens,
+                           const array& vertices, const array& edges)
+{
+  endclip(pentype);
+
+  size_t size=pens.size();
+  if(size == 0) return;
+
+  setfirstopacity(pens);
+  ColorSpace colorspace=maxcolorspace(pens);
+
+  mem::vector<unsigned char> flags;
+  mem::vector<pair> z;
+  mem::vector<pen> P;
+  for(size_t i=0; i < size; i++) {
+    flags.push_back((unsigned char) read<Int>(edges,i));
+    z.push_back(read<pair>(vertices,i));
+    pen *p=read<pen *>(pens,i);
+    promote(*p,colorspace);
+    P.push_back(*p);
+  }
+  meshshade(4,colorspace,flags,z,P);
+}
+
+void pdffile::tensorshade(const pen& pentype, const array& pens,
+                          const array& boundaries, const array& z)
+{
+  endclip(pentype);
+
+  size_t size=pens.size();
+  if(size == 0) return;
+  size_t nz=z.size();
+
+  array *p0=read<array *>(pens,0);
+  if(checkArray(p0) != 4)
+    reportError("4 pens required");
+  setfirstopacity(*p0);
+
+  ColorSpace colorspace=maxcolorspace2(pens);
+  checkColorSpace(colorspace);
+
+  // The vertices are in the order used by psfile::tensorshade, with only
+  // edge flag 0 (new patch).
+  mem::vector<unsigned char> flags;
+  mem::vector<pair> Z;
+  mem::vector<pen> P;
+  for(size_t i=0; i < size; i++) {
+    flags.push_back(0);
+    path g=read<path>(boundaries,i);
+    if(!(g.cyclic() && g.size() == 4))
+      reportError("specify cyclic path of length 4");
+    for(Int j=4; j > 0; --j) {
+      Z.push_back(g.point(j));
+      Z.push_back(g.precontrol(j));
+      Z.push_back(g.postcontrol(j-1));
+    }
+    if(nz == 0) { // Coons patch
+      static double nineth=1.0/9.0;
+      for(Int j=0; j < 4; ++j) {
+        Z.push_back(nineth*(-4.0*g.point(j)+6.0*(g.precontrol(j)+
+                                                 g.postcontrol(j))
+                            -2.0*(g.point(j-1)+g.point(j+1))
+                            +3.0*(g.precontrol(j-1)+g.postcontrol(j+1))
+                            -g.point(j+2)));
+      }
+    } else {
+      array *zi=read<array *>(z,i);
+      if(checkArray(zi) != 4)
+        reportError("specify 4 internal control points for each path");
+      Z.push_back(read<pair>(zi,0));
+      Z.push_back(read<pair>(zi,3));
+      Z.push_back(read<pair>(zi,2));
+      Z.push_back(read<pair>(zi,1));
+    }
+
+    array *pi=read<array *>(pens,i);
+    if(checkArray(pi) != 4)
+      reportError("specify 4 pens for each path");
+    static const int order[]={0,3,2,1};
+    for(size_t j=0; j < 4; ++j) {
+      pen *p=read<pen *>(pi,order[j]);
+      promote(*p,colorspace);
+      P.push_back(*p);
+    }
+  }
+  meshshade(7,colorspace,flags,Z,P);
+}
+
+} //namespace camp
@@ -0,0 +1,125 @@
+/*****
+ * pdffile.h
+ *
+ * Writes a picture directly as a single-page PDF file.
+ *****/
+
+#ifndef PDFFILE_H
+#define PDFFILE_H
+
+#include "psfile.h"
+#include "pdfreader.h"
+
+namespace camp {
+
+// Writes the page content with the PDF operators of psfile and collects the
+// shadings, images, and graphics states that it refers to, so that no
+// conversion from PostScript is needed.  PostScript-only features (verbatim
+// PostScript, fill patterns, and strokepath) are not supported; see
+// drawElement::nativepdf().
+class pdffile : public psfile {
+  std::ostream *file;
+  ostringstream content;
+  bbox box;
+
+  // Objects after the catalog, page tree, and page.
+  mem::vector<string> objects;
+
+  // Entries of the page resource dictionaries.
+  ostringstream extgstates;
+  ostringstream shadings;
+  ostringstream xobjects;
+
+  mem::map<string,size_t> gstates;
+  size_t nshadings;
+  size_t nimages;
+
+  // The objects copied from other files, and the forms made from their
+  // pages, indexed by file and object number.
+  typedef std::pair<const pdfdocument *,size_t> source;
+  mem::map<source,size_t> copied;
+  mem::map<source,size_t> forms;
+
+  ColorSpace imagecolorspace;
+
+  // The largest color space of the page content, in which transparency is
+  // blended.
+  ColorSpace groupcolorspace;
+  void usecolorspace(ColorSpace colorspace) {
+    if(colorspace > groupcolorspace && colorspace <= CMYK)
+      groupcolorspace=colorspace;
+  }
+
+  // PDF allows no other operators between the construction of a path and
+  // the operator that paints it, so the path is written only then, in the
+  // coordinates of any transforms concatenated in the meantime.
+  struct segment {
+    char op;
+    pair z[3];
+  };
+  mem::vector<segment> segments;
+  transform pathT;
+
+  void addSegment(char op, pair z0=pair(), pair z1=pair(),
+                  pair z2=pair());
+  bool writepath();
+
+  size_t addObject(const string& s);
+  size_t addStream(const string& dict, const unsigned char *data,
+                   size_t size);
+
+  void shade(size_t object);
+  void meshshade(Int type, ColorSpace colorspace,
+                 const mem::vector<unsigned char>& flags,
+                 const mem::vector<pair>& z, const mem::vector<pen>& pens);
+
+  void writecolor(const pen& p);
+
+  size_t copyObject(const pdfdocument *doc, size_t n);
+  string copyReferences(const pdfdocument *doc, const string& s);
+  size_t form(const pdfdocument *doc, size_t page);
+
+public:
+  pdffile(const string& filename);
+  ~pdffile();
+
+  void prologue(const bbox& b);
+  void epilogue();
+
+  void setopacity(const pen& p);
+  void setpen(pen p);
+
+  void newpath();
+  void moveto(pair z) {addSegment('m',z);}
+  void lineto(pair z) {addSegment('l',z);}
+  void curveto(pair zp, pair zm, pair z1) {addSegment('c',zp,zm,z1);}
+  void closepath() {addSegment('h');}
+
+  void stroke(const pen &p, bool dot=false);
+  void fill(const pen &p);
+  void endclip(const pen &p);
+
+  void translate(pair z);
+  void concat(transform t);
+
+  void imageheader(size_t width, size_t height, ColorSpace colorspace);
+  void outImage(bool antialias, size_t width, size_t height,
+                size_t ncomponents);
+
+  void latticeshade(const vm::array& a, const transform& t);
+  void gradientshade(bool axial, ColorSpace colorspace,
+                     const pen& pena, const pair& a, double ra,
+                     bool extenda, const pen& penb, const pair& b,
+                     double rb, bool extendb);
+  void gouraudshade(const pen& pentype, const vm::array& pens,
+                    const vm::array& vertices, const vm::array& edges);
+  void tensorshade(const pen& pentype, const vm::array& pens,
+                   const vm::array& boundaries, const vm::array& z);
+
+  // Draws a page of another PDF file, transformed by t, as a form.
+  void place(const pdfdocument *doc, size_t page, const transform& t);
+};
+
+}
+
+#endif
@@ -0,0 +1,328 @@
+/*****
+ * pdfreader.cc
+ *
+ * Reads PDF files written by TeX, so that their pages can be copied into
+ * pictures written by pdffile.
+ *****/
+
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#include "pdfreader.h"
+
+namespace camp {
+
+namespace {
+
+// A lexical token of PDF syntax.
+enum tokenKind {END, STRING, HEXSTRING, BEGINDICT, ENDDICT, BEGINARRAY,
+                ENDARRAY, BEGINPROC, ENDPROC, NAME, REGULAR};
+
+struct token {
+  tokenKind kind;
+  size_t start,end;
+};
+
+inline bool whitespace(char c)
+{
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' ||
+    c == 0;
+}
+
+inline bool delimiter(char c)
+{
+  return c != 0 && strchr("()<>[]{}/%",c) != NULL;
+}
+
+bool integer(const string& s, const token& t)
+{
+  if(t.kind != REGULAR) return false;
+  for(size_t i=t.start; i < t.end; ++i)
+    if(!isdigit(s[i])) return false;
+  return true;
+}
+
+bool keyword(const string& s, const token& t, const char *k)
+{
+  return t.kind == REGULAR && s.compare(t.start,t.end-t.start,k) == 0;
+}
+
+// Reads the token at pos, advancing pos past it.
+token next(const string& s, size_t& pos)
+{
+  size_t n=s.size();
+  for(;;) {
+    while(pos < n && whitespace(s[pos])) ++pos;
+    if(pos < n && s[pos] == '%') {
+      while(pos < n && s[pos] != '\n' && s[pos] != '\r') ++pos;
+    } else break;
+  }
+
+  token t;
+  t.start=pos;
+  if(pos >= n) {
+    t.kind=END;
+    t.end=pos;
+    return t;
+  }
+
+  char c=s[pos++];
+  switch(c) {
+    case '(': {
+      t.kind=STRING;
+      size_t depth=1;
+      while(pos < n && depth > 0) {
+        char d=s[pos++];
+        if(d == '\\') ++pos;
+        else if(d == '(') ++depth;
+        else if(d == ')') --depth;
+      }
+      break;
+    }
+    case '<':
+      if(pos < n && s[pos] == '<') {
+        ++pos;
+        t.kind=BEGINDICT;
+      } else {
+        t.kind=HEXSTRING;
+        while(pos < n && s[pos++] != '>');
+      }
+      break;
+    case '>':
+      if(pos < n && s[pos] == '>') ++pos;
+      t.kind=ENDDICT;
+      break;
+    case '[': t.kind=BEGINARRAY; break;
+    case ']': t.kind=ENDARRAY; break;
+    case '{': t.kind=BEGINPROC; break;
+    case '}': t.kind=ENDPROC; break;
+    default:
+      t.kind=c == '/' ? NAME : REGULAR;
+      while(pos < n && !whitespace(s[pos]) && !delimiter(s[pos])) ++pos;
+      break;
+  }
+  t.end=std::min(pos,n);
+  return t;
+}
+
+// Returns the end of the object that starts at pos, or string::npos if
+// there is none.
+size_t skipObject(const string& s, size_t pos)
+{
+  token t=next(s,pos);
+  switch(t.kind) {
+    case END:
+    case ENDDICT:
+    case ENDARRAY:
+    case ENDPROC:
+      return string::npos;
+    case BEGINDICT:
+    case BEGINARRAY:
+    case BEGINPROC: {
+      size_t depth=1;
+      while(depth > 0) {
+        t=next(s,pos);
+        if(t.kind == END) return string::npos;
+        if(t.kind == BEGINDICT || t.kind == BEGINARRAY ||
+           t.kind == BEGINPROC) ++depth;
+        else if(t.kind == ENDDICT || t.kind == ENDARRAY ||
+                t.kind == ENDPROC) --depth;
+      }
+      return t.end;
+    }
+    default:
+      break;
+  }
+
+  // An integer may begin an indirect reference.
+  if(integer(s,t)) {
+    size_t p=pos;
+    token g=next(s,p);
+    token r=next(s,p);
+    if(integer(s,g) && keyword(s,r,"R")) return r.end;
+  }
+  return t.end;
+}
+
+string trim(const string& s, size_t start, size_t end)
+{
+  while(start < end && whitespace(s[start])) ++start;
+  return s.substr(start,end-start);
+}
+
+// Reads the indirect reference s, returning false if it is not one.
+bool reference(const string& s, size_t& n)
+{
+  mem::vector<pdfreference> refs;
+  pdfdocument::references(s,refs);
+  if(refs.size() != 1 || refs[0].start != 0 || refs[0].end != s.size())
+    return false;
+  n=refs[0].object;
+  return true;
+}
+
+}
+
+bool pdfdocument::read(const string& filename)
+{
+  std::ifstream fin(filename.c_str(),std::ios::binary);
+  if(!fin) return false;
+  std::ostringstream buf;
+  buf << fin.rdbuf();
+  data=buf.str();
+
+  size_t pos=data.rfind("startxref");
+  if(pos == string::npos) return false;
+  pos += 9;
+  token t=next(data,pos);
+  if(!integer(data,t)) return false;
+  pos=atol(data.c_str()+t.start);
+
+  t=next(data,pos);
+  if(!keyword(data,t,"xref")) return false;
+
+  // Each subsection gives the number of its first object and its length,
+  // followed by an entry for each object.
+  for(;;) {
+    t=next(data,pos);
+    if(keyword(data,t,"trailer")) break;
+    token c=next(data,pos);
+    if(!integer(data,t) || !integer(data,c)) return false;
+    size_t first=atol(data.c_str()+t.start);
+    size_t count=atol(data.c_str()+c.start);
+    if(offsets.size() < first+count) offsets.resize(first+count,0);
+    for(size_t i=0; i < count; ++i) {
+      token offset=next(data,pos);
+      token generation=next(data,pos);
+      token type=next(data,pos);
+      if(!integer(data,offset) || !integer(data,generation))
+        return false;
+      if(keyword(data,type,"n"))
+        offsets[first+i]=atol(data.c_str()+offset.start);
+    }
+  }
+
+  size_t end=skipObject(data,pos);
+  if(end == string::npos) return false;
+  string trailer=data.substr(pos,end-pos);
+
+  // Incremental updates are not supported.
+  if(!lookup(trailer,"/Prev",false).empty()) return false;
+
+  size_t root;
+  if(!reference(lookup(trailer,"/Root",false),root)) return false;
+
+  string catalog,stream;
+  size_t pages;
+  return object(root,catalog,stream) &&
+    reference(lookup(catalog,"/Pages",false),pages) && addPages(pages,0);
+}
+
+bool pdfdocument::addPages(size_t n, size_t depth)
+{
+  // A page tree this deep must be circular.
+  if(depth > 64) return false;
+
+  string dict,stream;
+  if(!object(n,dict,stream)) return false;
+  string type=lookup(dict,"/Type");
+  if(type == "/Page") {
+    pagelist.push_back(n);
+    return true;
+  }
+  if(type != "/Pages") return false;
+
+  mem::vector<pdfreference> kids;
+  references(lookup(dict,"/Kids"),kids);
+  for(size_t i=0; i < kids.size(); ++i)
+    if(!addPages(kids[i].object,depth+1)) return false;
+  return true;
+}
+
+bool pdfdocument::object(size_t n, string& value, string& stream) const
+{
+  if(n >= offsets.size() || offsets[n] == 0) return false;
+
+  size_t pos=offsets[n];
+  token number=next(data,pos);
+  token generation=next(data,pos);
+  token obj=next(data,pos);
+  if(!integer(data,number) || !integer(data,generation) ||
+     !keyword(data,obj,"obj"))
+    return false;
+
+  size_t end=skipObject(data,pos);
+  if(end == string::npos) return false;
+  value=trim(data,pos,end);
+  stream.clear();
+
+  pos=end;
+  token t=next(data,pos);
+  if(keyword(data,t,"stream")) {
+    // The data begins after the end of the line.
+    if(pos < data.size() && data[pos] == '\r') ++pos;
+    if(pos < data.size() && data[pos] == '\n') ++pos;
+    string length=lookup(value,"/Length");
+    size_t p=0;
+    token l=next(length,p);
+    if(!integer(length,l)) return false;
+    size_t size=atol(length.c_str());
+    if(pos+size > data.size()) return false;
+    stream=data.substr(pos,size);
+  }
+  return true;
+}
+
+string pdfdocument::lookup(const string& dict, const string& key,
+                           bool resolve) const
+{
+  size_t pos=0;
+  token t=next(dict,pos);
+  if(t.kind != BEGINDICT) return "";
+
+  for(;;) {
+    t=next(dict,pos);
+    if(t.kind != NAME) return "";
+    size_t start=pos;
+    size_t end=skipObject(dict,pos);
+    if(end == string::npos) return "";
+    pos=end;
+    if(dict.compare(t.start,t.end-t.start,key) == 0) {
+      string value=trim(dict,start,end);
+      size_t n;
+      if(resolve && reference(value,n)) {
+        string v,stream;
+        if(object(n,v,stream) && stream.empty()) return v;
+      }
+      return value;
+    }
+  }
+}
+
+void pdfdocument::references(const string& s,
+                             mem::vector<pdfreference>& refs)
+{
+  size_t pos=0;
+  token none={END,0,0};
+  token prev[2]={none,none};
+  for(;;) {
+    token t=next(s,pos);
+    if(t.kind == END || keyword(s,t,"stream")) return;
+    if(keyword(s,t,"R") && integer(s,prev[0]) && integer(s,prev[1])) {
+      pdfreference r;
+      r.start=prev[0].start;
+      r.end=t.end;
+      r.object=atol(s.c_str()+prev[0].start);
+      refs.push_back(r);
+      prev[0]=prev[1]=none;
+      continue;
+    }
+    prev[0]=prev[1];
+    prev[1]=t;
+  }
+}
+
+}
@@ -0,0 +1,55 @@
+/*****
+ * pdfreader.h
+ *
+ * Reads PDF files written by TeX, so that their pages can be copied into
+ * pictures written by pdffile.
+ *****/
+
+#ifndef PDFREADER_H
+#define PDFREADER_H
+
+#include "common.h"
+
+namespace camp {
+
+// An indirect reference, "n g R", to object n, found at [start,end) in the
+// text of an object.
+struct pdfreference {
+  size_t start,end;
+  size_t object;
+};
+
+// A PDF file read into memory, with the object offsets of its
+// cross-reference table.  Cross-reference streams, which pdfTeX writes
+// unless \pdfobjcompresslevel=0, are not supported.
+class pdfdocument : public gc {
+  string data;
+  mem::vector<size_t> offsets;
+  mem::vector<size_t> pagelist;
+
+  bool addPages(size_t n, size_t depth);
+
+public:
+  // Reads the file, returning false if it cannot be parsed.
+  bool read(const string& filename);
+
+  // The object numbers of the pages, in order.
+  const mem::vector<size_t>& pages() const {return pagelist;}
+
+  // Finds object n, returning its value (for a stream, the dictionary) and
+  // the data of a stream, if any.
+  bool object(size_t n, string& value, string& stream) const;
+
+  // Returns the value of key, such as "/Type", in the dictionary dict, or an
+  // empty string if there is none.  An indirect reference is followed if
+  // resolve is set.
+  string lookup(const string& dict, const string& key,
+                bool resolve=true) const;
+
+  // Finds the indirect references in the value of an object.
+  static void references(const string& s, mem::vector<pdfreference>& refs);
+};
+
+}
+
+#endif
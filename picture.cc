@@ -16,6 +16,9 @@
 #include "drawlayer.h"
 #include "drawsurface.h"
 #include "drawpath3.h"
+#include "pdffile.h"
+#include "fragment.h"
+#include "raster.h"
 
 #ifdef __MSDOS__
 #include "sys/cygwin.h"
@@ -34,7 +37,7 @@ texstream::~texstream() {
   string name;
   if(!context) 
     name=stripFile(outname());
-  name += "texput.";
+  name += jobname+".";
   unlink((name+"aux").c_str());
   unlink((name+"log").c_str());
   unlink((name+"out").c_str());
@@ -52,6 +55,84 @@ texstream::~texstream() {
   }
 }
 
+size_t texpool::size()
+{
+  // Each process needs its own job name, which ConTeXt and the inline modes
+  // do not allow.
+  Int n=getSetting<Int>("texpool");
+  if(n <= 1 || settings::context(getSetting<string>("tex")) ||
+     getSetting<bool>("inlineimage") || getSetting<bool>("inlinetex"))
+    return 1;
+  return n;
+}
+
+texpool::worker *texpool::get(size_t i)
+{
+  assert(i > 0);
+  if(workers.size() < i)
+    workers.resize(i,NULL);
+
+  worker *&w=workers[i-1];
+  if(!w) {
+    ostringstream buf;
+    buf << "texput" << i;
+    w=new worker(buf.str());
+
+    mem::vector<string> cmd;
+    cmd.push_back(texprogram());
+    string dir=stripFile(outname());
+    if(!dir.empty()) 
+      cmd.push_back("-output-directory="+dir.substr(0,dir.length()-1));
+    cmd.push_back("-jobname="+w->tex.jobname);
+#ifdef __MSDOS__
+    cmd.push_back("NUL"); // For MikTeX
+#endif
+    cmd.push_back("\\scrollmode");
+    string texfatal="Transcript written on "+w->tex.jobname+".log.\n";
+
+    w->tex.open(cmd,"texpath",camp::texpathmessage(),Strdup(texfatal));
+    w->tex.wait("\n*");
+    w->tex << "\n";
+    camp::texdocumentclass(w->tex,true);
+    camp::texdefines(w->tex,processData().TeXpreamble,true,w->tex.jobname);
+    w->defined=processData().TeXpreamble.size();
+  }
+
+  define(w);
+  for(; w->replayed < verbatim.size(); ++w->replayed)
+    w->tex << verbatim[w->replayed] << "%" << camp::newl;
+  return w;
+}
+
+void texpool::define(worker *w)
+{
+  // The commands are taken from TeXpreamble, which holds all of them, so
+  // that each is sent exactly once however the process was started.
+  mem::list<string>& preamble=processData().TeXpreamble;
+  if(w->defined >= preamble.size()) return;
+  mem::list<string>::iterator p=preamble.begin();
+  std::advance(p,w->defined);
+  mem::list<string> commands;
+  commands.insert(commands.end(),p,preamble.end());
+  camp::texpreamble(w->tex,commands,true);
+  w->defined=preamble.size();
+}
+
+void texpool::preamble()
+{
+  for(size_t i=0; i < workers.size(); ++i)
+    if(workers[i])
+      define(workers[i]);
+}
+
+void texpool::close()
+{
+  for(size_t i=0; i < workers.size(); ++i)
+    delete workers[i];
+  workers.clear();
+  verbatim.clear();
+}
+
 namespace camp {
 
 extern void draw();
@@ -263,6 +344,30 @@ bool picture::havenewpage()
   return false;
 }
 
+bool picture::nativepdf()
+{
+  for(nodelist::iterator p=nodes.begin(); p != nodes.end(); ++p) {
+    assert(*p);
+    if(!(*p)->nativepdf())
+      return false;
+  }
+  return true;
+}
+
+// Whether the TeX code of the picture consists of labels that the fragment
+// cache can typeset.
+bool picture::placeable()
+{
+  for(nodelist::iterator p=nodes.begin(); p != nodes.end(); ++p) {
+    assert(*p);
+    if(!(*p)->islabel() || ((*p)->islayer() && !(*p)->isnewpage())) continue;
+    drawLabel *L=dynamic_cast<drawLabel *>(*p);
+    if(!L || !L->placeable())
+      return false;
+  }
+  return true;
+}
+
 bbox picture::bounds()
 {
   size_t n=nodes.size();
@@ -274,7 +379,10 @@ bbox picture::bounds()
     bboxstack.clear();
   }
   
-  if(havelabels()) texinit();
+  bool measure=havelabels();
+  if(measure) texinit();
+  string texengine=getSetting<string>("tex");
+  if(texengine == "none") measure=false;
   
   nodelist::iterator p=nodes.begin();
   processDataStruct& pd=processData();
@@ -282,7 +390,14 @@ bbox picture::bounds()
   for(size_t i=0; i < lastnumber; ++i) ++p;
   for(; p != nodes.end(); ++p) {
     assert(*p);
+    // Measure the labels up to the next TeX code together.
+    if(measure) {
+      drawLabel::measure(pd.tex,texengine,p,nodes.end());
+      measure=false;
+    }
     (*p)->bounds(b_cached,pd.tex,labelbounds,bboxstack);
+    if((*p)->islabel() && !dynamic_cast<drawLabel *>(*p))
+      measure=texengine != "none";
     
     // Optimization for interpreters with fixed stack limits.
     if((*p)->endclip()) {
@@ -352,9 +467,11 @@ void texinit()
   if(pd.tex.isopen()) {
     if(pd.TeXpipepreamble.empty()) return;
     texpreamble(pd.tex,pd.TeXpipepreamble,true);
+    pd.texworkers.preamble();
     pd.TeXpipepreamble.clear();
     return;
   }
+  pd.texworkers.close();
   
   bool context=settings::context(getSetting<string>("tex"));
   string dir=stripFile(outname());
@@ -399,10 +516,12 @@ void texinit()
   pd.tex.wait("\n*");
   pd.tex << "\n";
   texdocumentclass(pd.tex,true);
+  labelCache.reset();
   
   texdefines(pd.tex,pd.TeXpreamble,true);
   pd.TeXpipepreamble.clear();
 }
+
   
 int opentex(const string& texname, const string& prefix, bool dvi) 
 {
@@ -597,8 +716,160 @@ bool picture::texprocess(const string& texname, const string& outname,
   return false;
 }
 
+namespace {
+// Quotes s as a PostScript string.
+string psstring(const string& s)
+{
+  string t="(";
+  for(string::const_iterator p=s.begin(); p != s.end(); ++p) {
+    if(*p == '(' || *p == ')' || *p == '\\') t += '\\';
+    t += *p;
+  }
+  return t+")";
+}
+
+string absolutename(const string& name)
+{
+  if(!name.empty() && name[0] == '/') return name;
+  return string(getPath())+"/"+name;
+}
+
+// A Ghostscript interpreter that is kept running between conversions, with
+// -dJOBSERVER, so that each conversion is a job encapsulated in its own save
+// and restore.  With -safe, file access is limited to one directory, so the
+// interpreter is restarted when a conversion is in another one.
+class gsresident {
+  iopipestream gs;
+  string dir;
+  size_t jobs;
+  bool failed;
+
+  // Reads the output of gs up to the marker, which is removed.
+  bool readto(const string& marker, string& out) {
+    for(;;) {
+      string s;
+      gs >> s;
+      out += s;
+      size_t p=out.find(marker);
+      if(p < string::npos) {
+        out.erase(p);
+        return true;
+      }
+      if(!gs.running()) return false;
+    }
+  }
+
+  bool start(const string& Dir) {
+    dir=Dir;
+    mem::vector<string> cmd;
+    cmd.push_back(getSetting<string>("gs"));
+    cmd.push_back("-q");
+    cmd.push_back("-dNOPAUSE");
+    cmd.push_back("-P");
+    cmd.push_back("-sstderr=%stdout");
+    cmd.push_back("-sDEVICE=nullpage");
+    cmd.push_back("-dJOBSERVER");
+    cmd.push_back("-dEPSCrop");
+    if(safe) {
+      cmd.push_back("-dSAFER");
+      cmd.push_back("-dDELAYSAFER"); // Support transparency extensions.
+      cmd.push_back("--permit-file-read="+dir);
+      cmd.push_back("--permit-file-write="+dir);
+      cmd.push_back("-c");
+      cmd.push_back(".setsafe");
+      cmd.push_back("-f");
+    }
+    cmd.push_back("-");
+    gs.open(cmd,"gs","Ghostscript");
+
+    if(run("") == 0) return true;
+    gs.pipeclose();
+    if(verbose > 1)
+      cerr << "Cannot start resident Ghostscript" << endl;
+    return false;
+  }
+
+  // Runs the job, followed within it by code that prints a marker of its
+  // success, which an error would flush along with the rest of the job.
+  // The job is followed by another that prints a marker of its end.
+  int run(const string& job) {
+    ostringstream marker,success;
+    ++jobs;
+    marker << "%%[asy job " << jobs << "]%%";
+    success << "%%[asy job " << jobs << " done]%%";
+    gs << "\004" << job << "\n" << psstring(success.str()) << " = flush\n"
+       << "\004" << psstring(marker.str()) << " = flush\n";
+
+    string out;
+    if(!readto(marker.str(),out)) {
+      cerr << out;
+      gs.pipeclose();
+      return 1;
+    }
+    size_t p=out.find(success.str());
+    bool ok=p < string::npos;
+    if(ok) {
+      size_t n=success.str().size();
+      if(p+n < out.size() && out[p+n] == '\n') ++n;
+      out.erase(p,n);
+    }
+    if(!out.empty()) cerr << out;
+    return ok ? 0 : 1;
+  }
+
+public:
+  gsresident() : jobs(0), failed(false) {}
+
+  // Runs the PostScript code job, which reads and writes files in the
+  // directory dir, returning the exit status gs would have, or -1 if the
+  // conversion should be run by a new gs process.
+  int run(const string& Dir, const string& job) {
+    if(failed || !getSetting<bool>("gsresident") ||
+       !getSetting<string>("gsOptions").empty())
+      return -1;
+    if(!gs.isopen() || !gs.running() || (safe && Dir != dir)) {
+      gs.pipeclose();
+      if(!start(Dir)) {
+        failed=true;
+        return -1;
+      }
+    }
+    return run(job);
+  }
+};
+
+gsresident gsServer;
+}
+
 int picture::epstopdf(const string& epsname, const string& pdfname)
 {
+  string pdf=absolutename(pdfname);
+  string eps=absolutename(epsname);
+  string hwwidth=String(max(ceil(getSetting<double>("paperwidth")),1.0));
+  string hwheight=String(max(ceil(getSetting<double>("paperheight")),1.0));
+  string width=String(max(b.right-b.left,3.0));
+  string height=String(max(b.top-b.bottom,3.0));
+  if(stripFile(pdf) == stripFile(eps)) {
+    // Set the device parameters of the command line of a new gs process,
+    // the page size after the device size, which it overrides.
+    ostringstream job;
+    job << "(pdfwrite) selectdevice" << newl
+        << "<< /OutputFile " << psstring(pdf) << newl
+        << "   /HWSize [" << hwwidth << " " << hwheight << "]" << newl
+        << ">> setpagedevice" << newl
+        << "<< /PageSize [" << width << " " << height << "]" << newl
+        << "   /SubsetFonts true /EmbedAllFonts true /MaxSubsetPct 100"
+        << newl
+        << "   /PDFSETTINGS /prepress /CompatibilityLevel 1.4";
+    if(!getSetting<bool>("autorotate"))
+      job << " /AutoRotatePages /None";
+    job << newl << ">> setpagedevice" << newl
+        << psstring(eps) << " run" << newl
+        << "nulldevice";
+    int status=gsServer.run(stripFile(pdf),job.str());
+    if(status >= 0) return status;
+  }
+
   mem::vector<string> cmd;
   cmd.push_back(getSetting<string>("gs"));
   cmd.push_back("-q");
@@ -618,10 +889,9 @@ int picture::epstopdf(const string& epsname, const string& pdfname)
   cmd.push_back("-dCompatibilityLevel=1.4");
   if(!getSetting<bool>("autorotate"))
     cmd.push_back("-dAutoRotatePages=/None");
-  cmd.push_back("-g"+String(max(ceil(getSetting<double>("paperwidth")),1.0))
-                +"x"+String(max(ceil(getSetting<double>("paperheight")),1.0)));
-  cmd.push_back("-dDEVICEWIDTHPOINTS="+String(max(b.right-b.left,3.0)));
-  cmd.push_back("-dDEVICEHEIGHTPOINTS="+String(max(b.top-b.bottom,3.0)));
+  cmd.push_back("-g"+hwwidth+"x"+hwheight);
+  cmd.push_back("-dDEVICEWIDTHPOINTS="+width);
+  cmd.push_back("-dDEVICEHEIGHTPOINTS="+height);
   push_split(cmd,getSetting<string>("gsOptions"));
   cmd.push_back("-sOutputFile="+stripDir(pdfname));
   if(safe) {
@@ -803,20 +1073,30 @@ bool picture::postprocess(const string& prename, const string& outname,
       double res=render*72.0;
       Int antialias=getSetting<Int>("antialias");
       if(outputformat == "png" && antialias == 2) {
-        cmd.push_back(getSetting<string>("gs"));
-        cmd.push_back("-q");
-        cmd.push_back("-dNOPAUSE");
-        cmd.push_back("-dBATCH");
-        cmd.push_back("-P");
-        cmd.push_back("-sDEVICE=pngalpha");
-        cmd.push_back("-dEPSCrop");
-        if(safe)
-          cmd.push_back("-dSAFER");
-        cmd.push_back("-r"+String(res)+"x"+String(res));
-        push_split(cmd,getSetting<string>("gsOptions"));
-        cmd.push_back("-sOutputFile="+outname);
-        cmd.push_back(prename);
-        status=System(cmd,0,true,"gs","Ghostscript");
+        string png=absolutename(outname);
+        string eps=absolutename(prename);
+        status=stripFile(png) != stripFile(eps) ? -1 :
+          gsServer.run(stripFile(png),
+                       "(pngalpha) selectdevice\n<< /OutputFile "+
+                       psstring(png)+" /HWResolution ["+String(res)+" "+
+                       String(res)+"] >> setpagedevice\n"+psstring(eps)+
+                       " run\nnulldevice");
+        if(status < 0) {
+          cmd.push_back(getSetting<string>("gs"));
+          cmd.push_back("-q");
+          cmd.push_back("-dNOPAUSE");
+          cmd.push_back("-dBATCH");
+          cmd.push_back("-P");
+          cmd.push_back("-sDEVICE=pngalpha");
+          cmd.push_back("-dEPSCrop");
+          if(safe)
+            cmd.push_back("-dSAFER");
+          cmd.push_back("-r"+String(res)+"x"+String(res));
+          push_split(cmd,getSetting<string>("gsOptions"));
+          cmd.push_back("-sOutputFile="+outname);
+          cmd.push_back(prename);
+          status=System(cmd,0,true,"gs","Ghostscript");
+        }
       } else if(!svg && !getSetting<bool>("xasy")) {
         double expand=antialias;
         if(expand < 2.0) expand=1.0;
@@ -910,9 +1190,22 @@ string Outname(const string& prefix, const string& outputformat,
   return standardout ? "-" : buildname(prefix,outputformat,"");
 }
 
+namespace {
+void placeLabels(psfile *out, mem::vector<drawLabel *>& labels)
+{
+  pdffile *pdf=dynamic_cast<pdffile *>(out);
+  for(size_t i=0; i < labels.size(); ++i)
+    labels[i]->place(pdf);
+  labels.clear();
+}
+}
+
 bool picture::shipout(picture *preamble, const string& Prefix,
                       const string& format, bool wait, bool view)
 {
+  // Report any image that could not be written in the background.
+  camp::finishRaster();
+
   b=bounds();
   
   string texengine=getSetting<string>("tex");
@@ -963,8 +1256,22 @@ bool picture::shipout(picture *preamble, const string& Prefix,
   if(Labels)
     prefix=cleanpath(prefix);
   
+  // Write the PDF file, or each PDF layer for TeX, directly.
+  bool native=getSetting<bool>("nativepdf") && !svg && !standardout &&
+    (Labels ? pdf && !b.empty : outputformat == "pdf") && nativepdf() &&
+    (!preamble || preamble->nativepdf());
+  
+  // Place labels typeset once by pdfTeX, rather than having TeX put them on
+  // the layers of the picture.
+  bool fragments=native && Labels && !TeXmode && outputformat == "pdf" &&
+    (texengine == "pdflatex" || texengine == "pdftex") &&
+    getSetting<bool>("labelfragments") && placeable() &&
+    fragmentCache.typeset(prefix,nodes);
+  if(fragments) Labels=false;
+
   string prename=((epsformat && !pdf) || !Labels) ? epsname : 
     auxname(prefix,preformat);
+  if(native && !Labels) prename=outname;
   
   SetPageDimensions();
   
@@ -1031,12 +1338,13 @@ bool picture::shipout(picture *preamble, const string& Prefix,
     }
     files.push_back(psname);
     if(pdf) files.push_back(pdfname);
-    psfile out(psname,pdfformat);
-    out.prologue(bshift);
+    psfile *out=native ? new pdffile(Labels ? pdfname : outname) :
+      new psfile(psname,pdfformat);
+    out->prologue(bshift);
   
     if(!Labels) {
-      out.gsave();
-      out.translate(bboxshift);
+      out->gsave();
+      out->translate(bboxshift);
     }
   
     if(preamble) {
@@ -1044,27 +1352,38 @@ bool picture::shipout(picture *preamble, const string& Prefix,
       nodelist Nodes=preamble->nodes;
       nodelist::iterator P=Nodes.begin();
       if(P != Nodes.end()) {
-        out.resetpen();
+        out->resetpen();
         for(; P != Nodes.end(); ++P) {
           assert(*P);
-          (*P)->draw(&out);
+          (*P)->draw(out);
         }
       }
     }
-    out.resetpen();
+    out->resetpen();
     
     bool postscript=false;
     drawLabel *L=NULL;
+    mem::vector<drawLabel *> placed;
     
     if(dvi)
       for(nodelist::const_iterator r=begin.begin(); r != begin.end(); ++r)
-        (*r)->draw(&out);
+        (*r)->draw(out);
     
     processDataStruct &pd=processData();
     
     for(; p != nodes.end(); ++p) {
       assert(*p);
       if(Labels && (*p)->islayer()) break;
+
+      if(fragments) {
+        // As with TeX, the labels of a layer go above its drawing.
+        if((*p)->islayer())
+          placeLabels(out,placed);
+        else if((*p)->islabel()) {
+          placed.push_back(dynamic_cast<drawLabel *>(*p));
+          continue;
+        }
+      }
       
       if(dvi && (*p)->svg()) {
         picture *f=(*p)->svgpng() ? new picture : NULL;
@@ -1102,7 +1421,7 @@ bool picture::shipout(picture *preamble, const string& Prefix,
         
         for(nodelist::reverse_iterator r=end.rbegin(); r != end.rend();
             ++r) {
-          (*r)->draw(&out);
+          (*r)->draw(out);
           if(f)
             f->append(*r);
         }
@@ -1129,23 +1448,27 @@ bool picture::shipout(picture *preamble, const string& Prefix,
           postscript=true;
         }
         break;
-      } else postscript |= (*p)->draw(&out);
+      } else postscript |= (*p)->draw(out);
     }
     
     if(Labels) {
       if(!svg || pdf)
         tex->beginlayer(pdf ? pdfname : psname,postscript);
-    } else out.grestore();
+    } else {
+      if(fragments) placeLabels(out,placed);
+      out->grestore();
+    }
     
-    out.epilogue();
-    out.close();
+    out->epilogue();
+    out->close();
+    delete out;
     
 //    if(out.Transparency())
 //      transparency=true;
     
     if(Labels) {
       tex->resetpen();
-      if(pdf && !b.empty) {
+      if(pdf && !b.empty && !native) {
         status=(epstopdf(psname,pdfname) == 0);
         if(!getSetting<bool>("keep")) unlink(psname.c_str());
       }
@@ -1194,7 +1517,7 @@ bool picture::shipout(picture *preamble, const string& Prefix,
       if(status) {
         if(context) prename=stripDir(prename);
         status=postprocess(prename,outname,outputformat,wait,
-                           view,pdf && Labels,epsformat,svg);
+                           view,(pdf && Labels) || native,epsformat,svg);
         if(pdfformat && !getSetting<bool>("keep")) {
           unlink(auxname(prefix,"m9").c_str());
           unlink(auxname(prefix,"pbsdat").c_str());
@@ -1268,6 +1591,8 @@ bool picture::shipout3(const string& prefix, const string& format,
 {
   if(getSetting<bool>("interrupt"))
     return true;
+
+  camp::finishRaster();
   
   bool webgl=format == "html";
   
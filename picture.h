@@ -58,6 +58,8 @@ public:
   bool have3D();
   bool havepng();
   bool havenewpage();
+  bool nativepdf();
+  bool placeable();
 
   bbox bounds();
   bbox3 bounds3();
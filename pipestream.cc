@@ -21,6 +21,7 @@
 #include <cerrno>
 #include <sstream>
 #include <signal.h>
+#include <fcntl.h>
 
 #include "pipestream.h"
 #include "common.h"
@@ -59,29 +60,26 @@ void iopipestream::open(const mem::vector<string> &command, const char *hint,
   }
   cout.flush(); // Flush stdout to avoid duplicate output.
 
-  if((pid=fork()) < 0) {
-    ostringstream buf;
-    buf << "fork failed: ";
-    for(size_t i=0; i < command.size(); ++i) buf << command[i];
-    camp::reportError(buf);
-  }
+  // The parent's ends of the pipes must not be inherited by the command.
+  fcntl(in[1],F_SETFD,FD_CLOEXEC);
+  fcntl(out[0],F_SETFD,FD_CLOEXEC);
 
-  if(pid == 0) {
-    if(interact::interactive) signal(SIGINT,SIG_IGN);
+  char **argv=args(command);
+  pid=spawn(argv,0,hint,application,in[0],out[1],out_fileno);
+  char **p=argv;
+  char *s;
+  while((s=*(p++)) != NULL)
+    delete [] s;
+  delete [] argv;
+
+  if(pid < 0) {
+    close(in[0]);
     close(in[1]);
     close(out[0]);
-    close(STDIN_FILENO);
-    close(out_fileno);
-    dup2(in[0],STDIN_FILENO);
-    dup2(out[1],out_fileno);
-    close(in[0]);
     close(out[1]);
-    char **argv=args(command);
-    if(argv) execvp(argv[0],argv);
-    execError(argv[0],hint,application);
-    kill(0,SIGPIPE);
-    _exit(-1);
+    throw handled_error();
   }
+
   instance=this;
   Signal(SIGPIPE,pipeHandler);
   close(out[1]);
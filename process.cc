@@ -902,6 +902,13 @@ void processFile(const string& filename, bool purge) {
 void processPrompt() {
   iprompt().process();
 }
+void preloadModules(const mem::vector<string>& modules) {
+  penv pe;
+  for(mem::vector<string>::const_iterator p=modules.begin();
+      p != modules.end(); ++p)
+    pe.ge().getModule(symbol::trans(*p),*p);
+  em.sync();
+}
 
 void runCode(absyntax::block *code) {
   icode(code).doExec();
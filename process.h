@@ -29,6 +29,10 @@ void processCode(absyntax::block *code);
 void processFile(const string& filename, bool purge=false);
 void processPrompt();
 
+// Translate plain (if autoplain is set) and the given modules, so that later
+// files can reuse the translations.
+void preloadModules(const mem::vector<string>& modules);
+
 // Run the code in its own environment.
 void runCode(absyntax::block *code);
 void runString(const string& s, bool interactiveWrite=false);
@@ -83,9 +87,56 @@ public:
 
 class texstream : public iopipestream {
 public:
+  // The job name, which determines the names of the files written by TeX.
+  string jobname;
+
+  texstream(const string& jobname="texput") : jobname(jobname) {}
   ~texstream();
 };
 
+// Additional TeX processes, started on demand, among which the measurement
+// of labels is shared with the main pipe.  Each is given the same preamble
+// and verbatim TeX code as the main pipe.
+class texpool {
+public:
+  struct worker : public gc {
+    texstream tex;
+    camp::pen lastpen; // The pen whose font is selected in tex.
+    size_t defined;    // The number of preamble commands sent to tex.
+    size_t replayed;   // The number of lines of verbatim code sent to tex.
+
+    worker(const string& jobname)
+      : tex(jobname), lastpen(camp::initialpen), defined(0), replayed(0) {}
+  };
+
+private:
+  mem::vector<worker *> workers;
+
+  // The verbatim TeX code sent to the main pipe since it was started.
+  mem::vector<string> verbatim;
+
+  // Sends the preamble commands that w has not yet been given.
+  void define(worker *w);
+
+public:
+  ~texpool() {close();}
+
+  // The number of processes to use, including the main pipe.
+  size_t size();
+
+  // Returns the process i, for 0 < i < size(), starting it if necessary.
+  worker *get(size_t i);
+
+  // Sends new preamble commands to the running processes.
+  void preamble();
+
+  // Records verbatim code sent to the main pipe.
+  void sent(const string& s) {verbatim.push_back(s);}
+
+  // Stops all of the processes.
+  void close();
+};
+
 typedef std::pair<size_t,size_t> linecolumn;
 typedef mem::map<CONST linecolumn,string> xkey_t;
 typedef mem::deque<camp::transform> xtransform_t;
@@ -93,6 +144,7 @@ typedef mem::map<CONST string,xtransform_t> xmap_t;
 
 struct processDataStruct {
   texstream tex; // Bi-directional pipe to latex (to find label bbox)
+  texpool texworkers;
   mem::list<string> TeXpipepreamble;
   mem::list<string> TeXpreamble;
   vm::callable *atExitFunction;
@@ -8,9 +8,10 @@
 #ifndef PROFILER_H
 #define PROFILER_H
 
-#include <sys/time.h>
+#include <time.h>
 
 #include <iostream>
+#include <sstream>
 
 #include "inst.h"
 
@@ -30,7 +31,7 @@ inline position positionFromLambda(lambda *func) {
   if (code.begin() == code.end())
     return position();
 
-  return code.begin()->pos;
+  return code.getPos(&*code.begin());
 }
 
 inline void printNameFromLambda(ostream& out, lambda *func) {
@@ -83,15 +84,15 @@ class profiler : public gc {
 
     // The number of times the top-level function has been called resulting in
     // this specific call stack.
-    int calls;
+    size_t calls;
 
     // The number of bytecode instructions executed with this exact call stack.
     // It does not include time spent in called function.
-    int instructions;
+    size_t instructions;
 
     // Number of instructions spent in this function or its children.  This is
     // computed by computeTotals.
-    int instTotal;
+    size_t instTotal;
 
     // The number of real-time nanoseconds spent in this node.  WARNING: May
     // be wildly inaccurate.
@@ -100,23 +101,40 @@ class profiler : public gc {
     // Total including children.
     long long nsecsTotal;
 
+    // The processor time, in nanoseconds, spent in this node, and the total
+    // including children.  This differs from nsecs when waiting, for instance
+    // on a pipe to TeX.
+    long long cpuNsecs;
+    long long cpuNsecsTotal;
+
+    // The number of bytes allocated on the garbage-collected heap in this
+    // node, and the total including children.  Zero without the collector.
+    long long bytes;
+    long long bytesTotal;
+
     // Call stacks resulting from calls during this call stack.
     mem::vector<node> children;
 
     node()
       : func(0), cfunc(0), calls(0),
         instructions(0), instTotal(0),
-        nsecs(0), nsecsTotal(0) {}
+        nsecs(0), nsecsTotal(0),
+        cpuNsecs(0), cpuNsecsTotal(0),
+        bytes(0), bytesTotal(0) {}
 
     node(lambda *func)
       : func(func), cfunc(0), calls(0),
         instructions(0), instTotal(0),
-        nsecs(0), nsecsTotal(0) {}
+        nsecs(0), nsecsTotal(0),
+        cpuNsecs(0), cpuNsecsTotal(0),
+        bytes(0), bytesTotal(0) {}
 
     node(bltin b)
       : func(0), cfunc(b), calls(0),
         instructions(0), instTotal(0),
-        nsecs(0), nsecsTotal(0) {}
+        nsecs(0), nsecsTotal(0),
+        cpuNsecs(0), cpuNsecsTotal(0),
+        bytes(0), bytesTotal(0) {}
 
     // Return the call stack resulting from a call to func when this call
     // stack is current.
@@ -144,14 +162,52 @@ class profiler : public gc {
     void computeTotals() {
       instTotal = instructions;
       nsecsTotal = nsecs;
+      cpuNsecsTotal = cpuNsecs;
+      bytesTotal = bytes;
       size_t n = children.size();
       for (size_t i = 0; i < n; ++i) {
         children[i].computeTotals();
         instTotal += children[i].instTotal;
         nsecsTotal += children[i].nsecsTotal;
+        cpuNsecsTotal += children[i].cpuNsecsTotal;
+        bytesTotal += children[i].bytesTotal;
       }
     }
 
+    // The real time spent in builtin functions called from this call stack,
+    // excluding any asymptote code they call back into.
+    long long bltinNsecs() {
+      long long total = cfunc ? nsecs : 0;
+      size_t n = children.size();
+      for (size_t i = 0; i < n; ++i)
+        total += children[i].bltinNsecs();
+      return total;
+    }
+
+    void printName(ostream& out) {
+      if (cfunc)
+        printNameFromBltin(out, cfunc);
+      else
+        printNameFromLambda(out, func);
+    }
+
+    // Dump the call stacks as "collapsed stacks": one line per call stack,
+    // giving the semicolon-separated functions, outermost first, and the real
+    // time in nanoseconds spent in the innermost one.  This is read by
+    // flamegraph.pl and similar tools.
+    void folddump(ostream& out, const string& prefix) {
+      std::ostringstream name;
+      name << prefix;
+      printName(name);
+      string stack = name.str();
+
+      if (nsecs > 0)
+        out << stack << " " << nsecs << "\n";
+
+      size_t n = children.size();
+      for (size_t i = 0; i < n; ++i)
+        children[i].folddump(out, stack + ";");
+    }
 
 
     void pydump(ostream& out) {
@@ -167,6 +223,8 @@ class profiler : public gc {
            << "    calls = " << calls << ",\n"
            << "    instructions = " << instructions << ",\n"
            << "    nsecs = " << nsecs << ",\n"
+           << "    cpuNsecs = " << cpuNsecs << ",\n"
+           << "    bytes = " << bytes << ",\n"
            << "    children = [\n";
 
       size_t n = children.size();
@@ -192,27 +250,40 @@ class profiler : public gc {
   // Arc representing one function calling another.  Used only for building
   // the output for kcachegrind.
   struct arc : public gc {
-    int calls;
-    int instTotal;
+    size_t calls;
+    size_t instTotal;
     long long nsecsTotal;
+    long long cpuNsecsTotal;
+    long long bytesTotal;
 
-    arc() : calls(0), instTotal(0), nsecsTotal(0) {}
+    arc() : calls(0), instTotal(0), nsecsTotal(0),
+            cpuNsecsTotal(0), bytesTotal(0) {}
 
     void add(node& n) {
       calls += n.calls;
       instTotal += n.instTotal;
       nsecsTotal += n.nsecsTotal;
+      cpuNsecsTotal += n.cpuNsecsTotal;
+      bytesTotal += n.bytesTotal;
+    }
+
+    void dump(ostream& out, const string& pos) {
+      out << "calls=" << calls << " " << pos << "\n";
+      out << pos << " " << instTotal << " " << nsecsTotal << " "
+          << cpuNsecsTotal << " " << bytesTotal << "\n";
     }
   };
 
   // Representing one function and its calls to other functions.
   struct fun : public gc {
-    int instructions;
+    size_t instructions;
     long long nsecs;
+    long long cpuNsecs;
+    long long bytes;
     mem::map<lambda *, arc> arcs;
     mem::map<bltin, arc> carcs;
 
-    fun() : instructions(0), nsecs(0) {}
+    fun() : instructions(0), nsecs(0), cpuNsecs(0), bytes(0) {}
 
     void addChildTime(node& n) {
       if (n.cfunc)
@@ -224,6 +295,8 @@ class profiler : public gc {
     void analyse(node& n) {
       instructions += n.instructions;
       nsecs += n.nsecs;
+      cpuNsecs += n.cpuNsecs;
+      bytes += n.bytes;
       size_t numChildren = n.children.size();
       for (size_t i = 0; i < numChildren; ++i)
         addChildTime(n.children[i]);
@@ -233,7 +306,8 @@ class profiler : public gc {
       // The unused line number needed by kcachegrind.
       static const string POS = "1";
 
-      out << POS << " " << instructions << " " << nsecs << "\n";
+      out << POS << " " << instructions << " " << nsecs << " "
+          << cpuNsecs << " " << bytes << "\n";
       for (mem::map<lambda *, arc>::iterator i = arcs.begin();
            i != arcs.end();
            ++i)
@@ -247,8 +321,7 @@ class profiler : public gc {
         printNameFromLambda(out, l);
         out << "\n";
 
-        out << "calls=" << a.calls << " " << POS << "\n";
-        out << POS << " " << a.instTotal << " " << a.nsecsTotal << "\n";
+        a.dump(out, POS);
       }
       for (mem::map<bltin, arc>::iterator i = carcs.begin();
            i != carcs.end();
@@ -263,8 +336,7 @@ class profiler : public gc {
         printNameFromBltin(out, b);
         out << "\n";
 
-        out << "calls=" << a.calls << " " << POS << "\n";
-        out << POS << " " << a.instTotal << " " << a.nsecsTotal << "\n";
+        a.dump(out, POS);
       }
     }
   };
@@ -293,26 +365,77 @@ class profiler : public gc {
   }
 
 
-  // Timing data.
-  struct timeval timestamp;
+  // Timing and allocation data at the start of the current lap.
+  struct lap {
+    long long nsecs;
+    long long bytes;
 
-  void startLap() {
-    gettimeofday(&timestamp, 0);
-  }
+    static long long read(clockid_t clock) {
+      struct timespec t;
+      clock_gettime(clock, &t);
+      return 1000000000LL * t.tv_sec + t.tv_nsec;
+    }
+
+    void now() {
+      nsecs = read(CLOCK_MONOTONIC);
+#ifdef USEGC
+      bytes = (long long) GC_get_total_bytes();
+#else
+      bytes = 0;
+#endif
+    }
+  };
+  lap timestamp;
+
+  // The cost of taking a timestamp, measured when the profiler starts and
+  // subtracted from each lap, so that short calls are not charged for the
+  // profiler itself.
+  long long overhead;
+
+  // The processor time clock costs several times as much to read as the
+  // monotonic one, so it is read only after laps of at least cpuInterval
+  // nanoseconds.  A shorter lap is too short to wait on anything, so its
+  // processor time is taken to be its real time; the estimate is corrected
+  // at the next reading.
+  static const long long cpuInterval = 20000;
+  long long cpuStamp;     // The processor time at the last reading.
+  long long cpuEstimated; // The processor time estimated since then.
 
-  long long timeAndResetLap() {
-    struct timeval now;
-    gettimeofday(&now, 0);
-    long long nsecs = 1000000000LL * (now.tv_sec - timestamp.tv_sec) +
-                      1000LL * (now.tv_usec - timestamp.tv_usec);
-    timestamp = now;
-    return nsecs;
+  void startLap() {
+    const int n = 1000;
+    lap start;
+    start.now();
+    for (int i = 0; i < n; ++i)
+      timestamp.now();
+    overhead = (timestamp.nsecs - start.nsecs) / n;
+
+    cpuStamp = lap::read(CLOCK_PROCESS_CPUTIME_ID);
+    cpuEstimated = 0;
+    timestamp.now();
   }
 
   // Called whenever the stack is about to change, in order to record the time
-  // duration for the current node.
-  void recordTime() {
-    topnode().nsecs += timeAndResetLap();
+  // duration and allocations for the current node.  The processor time is
+  // read regardless of the length of the lap if readCpu is true.
+  void recordTime(bool readCpu=false) {
+    lap then = timestamp;
+    timestamp.now();
+
+    node& n = topnode();
+    long long nsecs = timestamp.nsecs - then.nsecs - overhead;
+    if (nsecs < 0) nsecs = 0;
+    n.nsecs += nsecs;
+    if (nsecs < cpuInterval && !readCpu) {
+      n.cpuNsecs += nsecs;
+      cpuEstimated += nsecs;
+    } else {
+      long long cpu = lap::read(CLOCK_PROCESS_CPUTIME_ID);
+      long long cpuNsecs = cpu - cpuStamp - cpuEstimated;
+      if (cpuNsecs > 0) n.cpuNsecs += cpuNsecs;
+      cpuStamp = cpu;
+      cpuEstimated = 0;
+    }
+    n.bytes += timestamp.bytes - then.bytes;
   }
 
 public:
@@ -329,9 +452,21 @@ public:
   // Dump all of the data out in a format that can be read into Python.
   void pydump(ostream &out);
 
-  // Dump all of the data in a format for kcachegrind.
+  // Dump all of the data in the callgrind format, for kcachegrind.
   void dump(ostream& out);
 
+  // Dump the call stacks in the collapsed format used for flame graphs.
+  void folddump(ostream& out);
+
+  // Print a summary of the time and memory used.
+  void summary(ostream& out);
+
+  // The total number of bytecode instructions executed so far.  Comparing
+  // this with and without -nooptimize measures the peephole optimizer.
+  size_t totalInstructions() {
+    emptynode.computeTotals();
+    return emptynode.instTotal;
+  }
 };
 
 inline profiler::profiler()
@@ -392,9 +527,10 @@ inline void profiler::pydump(ostream& out) {
 }
 
 inline void profiler::dump(ostream& out) {
+  recordTime(true);
   analyseData();
 
-  out << "events: Instructions Nanoseconds\n";
+  out << "events: Instructions Nanoseconds CpuNanoseconds Bytes\n";
 
   for (mem::map<lambda *, fun>::iterator i = funs.begin();
        i != funs.end();
@@ -426,6 +562,28 @@ inline void profiler::dump(ostream& out) {
 
     f.dump(out);
   }
+
+  out << "totals: " << emptynode.instTotal << " "
+      << emptynode.nsecsTotal << " " << emptynode.cpuNsecsTotal << " "
+      << emptynode.bytesTotal << "\n";
+}
+
+inline void profiler::folddump(ostream& out) {
+  recordTime(true);
+  emptynode.folddump(out, "");
+}
+
+inline void profiler::summary(ostream& out) {
+  recordTime(true);
+  emptynode.computeTotals();
+
+  out << "asyprof: " << emptynode.nsecsTotal/1e9 << "s real ("
+      << emptynode.bltinNsecs()/1e9 << "s in builtins), "
+      << emptynode.cpuNsecsTotal/1e9 << "s cpu";
+#ifdef USEGC
+  out << ", " << emptynode.bytesTotal << " bytes allocated";
+#endif
+  out << endl;
 }
 
 
@@ -6,6 +6,7 @@
  *****/
 
 #include <iostream>
+#include <algorithm>
 #include "util.h"
 #include "callable.h"
 #include "program.h"
@@ -64,6 +65,18 @@ ostream& operator<< (ostream& out, const item& i)
     return out << x;
 
   return out << "<item " << p << ">";
+#elif NANBOX
+  // The kind of value, but not its type, is known from the encoding.
+  if (i.isInt())
+    return out << "Int, value = " << i.toInt();
+  if (i.isReal())
+    return out << "real, value = " << i.toReal();
+  if (i.bits == NanBoxTrue)
+    return out << "true";
+  if (i.bits == NanBoxFalse)
+    return out << "false";
+
+  return out << "<item " << i.toPointer() << ">";
 #else
   // TODO: Make a data structure mapping typeids to print functions.
   else if (i.type() == typeid(Int))
@@ -147,6 +160,16 @@ void printInst(ostream& out, const program::label& code,
 #endif
       break;
     }
+
+    case 's':
+    {
+      funcslot *fs = get<funcslot*>(*code);
+#ifdef DEBUG_FRAME
+      out << " " << fs->body->name;
+#endif
+      out << " " << fs->index;
+      break;
+    }
     
     default: {
       /* nothing else to do */
@@ -169,4 +192,111 @@ void print(ostream& out, program *base)
   }
 }
 
+namespace {
+// Ops whose effect is cancelled by an immediately following pop.
+inline bool purepush(inst::opcode op)
+{
+  return op == inst::varpush || op == inst::intpush ||
+         op == inst::constpush;
+}
+}
+
+void program::optimize()
+{
+  size_t n = code.size();
+
+  // Instructions that are jump targets cannot be folded into the
+  // instruction before them.
+  mem::vector<bool> target(n+1, false);
+  for (size_t k = 0; k < n; ++k) {
+    inst& i = code[k];
+    if (optypes[i.op] == 'o' && !i.ref.empty()) {
+      label l = get<label>(i);
+      assert(l.code == this);
+      target[l.where] = true;
+    }
+  }
+
+  // Position in the optimized code of each original instruction, or of the
+  // next surviving one, if it was removed.
+  mem::vector<size_t> newpos(n+1);
+  code_t out;
+  out.reserve(n);
+
+  positions_t oldpos;
+  oldpos.swap(positions);
+  positions_t::const_iterator pp = oldpos.begin();
+
+  for (size_t k = 0; k < n;) {
+    inst& i = code[k];
+    inst::opcode op1 = (k+1 < n && !target[k+1]) ? code[k+1].op : inst::nop;
+    size_t start = out.size();
+    size_t len = 1;
+
+    if (i.op == inst::pushclosure && op1 == inst::makefunc && k+3 < n &&
+        code[k+2].op == inst::varsave && !target[k+2] &&
+        code[k+3].op == inst::pop && !target[k+3]) {
+      inst f = i;
+      f.op = inst::savefunc;
+      f.ref = new funcslot(get<lambda*>(code[k+1]), get<Int>(code[k+2]));
+      out.push_back(f);
+      len = 4;
+    }
+    else if (purepush(i.op) && op1 == inst::pop) {
+      // No-op; nothing is encoded.
+      len = 2;
+    }
+    else if (op1 == inst::pop &&
+             (i.op == inst::varsave || i.op == inst::fieldsave)) {
+      out.push_back(i);
+      out.back().op = i.op == inst::varsave ? inst::varpop : inst::fieldpop;
+      len = 2;
+    }
+    else if (i.op == inst::popcall && k+1 < n && code[k+1].op == inst::ret) {
+      // A call in tail position.  The ret is kept only if it is reached
+      // by a jump.
+      out.push_back(i);
+      out.back().op = inst::tailcall;
+      len = target[k+1] ? 1 : 2;
+    }
+    else if (op1 == inst::popcall &&
+             (i.op == inst::varpush || i.op == inst::fieldpush) &&
+             !(k+2 < n && code[k+2].op == inst::ret)) {
+      // (Unless the call is a tail call.)
+      out.push_back(i);
+      out.back().op = i.op == inst::varpush ? inst::varcall : inst::fieldcall;
+      len = 2;
+    }
+    else
+      out.push_back(i);
+
+    if (out.size() > start) {
+      // A folded sequence takes the position of its first instruction.
+      while (pp != oldpos.end() && pp+1 != oldpos.end() && (pp+1)->where <= k)
+        ++pp;
+      if (pp != oldpos.end() && pp->where <= k)
+        markPos(start, pp->pos);
+    }
+
+    // Only the first instruction of a folded sequence can be a target.
+    for (size_t j = 0; j < len; ++j)
+      newpos[k+j] = start;
+    k += len;
+  }
+  newpos[n] = out.size();
+
+  for (code_t::iterator p = out.begin(); p != out.end(); ++p)
+    if (optypes[p->op] == 'o' && !p->ref.empty())
+      p->ref = label(newpos[get<label>(*p).where], this);
+
+  code.swap(out);
+}
+
+position program::getPos(size_t n) const
+{
+  positions_t::const_iterator p =
+    std::upper_bound(positions.begin(), positions.end(), n, startsAfter);
+  return p == positions.begin() ? nullPos : (--p)->pos;
+}
+
 } // namespace vm
@@ -22,15 +22,55 @@ class program : public gc {
 public:
   class label;
   program();
-  void encode(inst i);
+  void encode(inst i, position pos);
   label begin();
   label end();
   inst &back();
   void pop_back();
+
+  // Rewrites common instruction sequences into superinstructions (see
+  // opcodes.h) and removes those with no effect.  Jump targets are
+  // remapped, so this must only be called once all labels are defined.
+  void optimize();
+
+  size_t size() const;
+
+  // The source position of an instruction in this program.
+  position getPos(const inst *i) const;
+
+  // The memory used by the instructions and by the table of positions.
+  size_t codeBytes() const;
+  size_t posBytes() const;
+
+#ifdef THREADED_DISPATCH
+  // Resolves the opcode of each instruction to its handler address, given a
+  // table of handlers indexed by opcode.
+  void thread(const void *const *handlers);
+  bool threaded() const;
+#endif
 private:
   friend class label;
   typedef mem::vector<inst> code_t;
   code_t code;
+
+  // Positions are only needed for error messages, debugging and
+  // profiling, so they are kept out of the instructions.  Each entry gives
+  // the position of a run of instructions, starting at offset where.
+  struct posEntry {
+    size_t where;
+    position pos;
+  };
+  typedef mem::vector<posEntry> positions_t;
+  positions_t positions;
+
+  // Sets the position of the instructions from offset where onwards.
+  void markPos(size_t where, const position& pos);
+  position getPos(size_t n) const;
+  static bool startsAfter(size_t n, const posEntry& e)
+  { return n < e.where; }
+#ifdef THREADED_DISPATCH
+  bool isThreaded;
+#endif
   inst& operator[](size_t);
 };
 
@@ -65,7 +105,11 @@ void print(std::ostream& out, program *base);
 
 // Inline forwarding functions for vm::program
 inline program::program()
-  : code() {}
+  : code(), positions()
+#ifdef THREADED_DISPATCH
+  , isThreaded(false)
+#endif
+{}
 inline program::label program::end()
 { return label(code.size(), this); }
 inline program::label program::begin()
@@ -73,9 +117,41 @@ inline program::label program::begin()
 inline inst& program::back()
 { return code.back(); }
 inline void program::pop_back()
-{ return code.pop_back(); }
-inline void program::encode(inst i)
-{ code.push_back(i); }
+{
+  code.pop_back();
+  if (!positions.empty() && positions.back().where == code.size())
+    positions.pop_back();
+}
+inline void program::markPos(size_t where, const position& pos)
+{
+  if (positions.empty() || !(positions.back().pos == pos)) {
+    posEntry e = { where, pos };
+    positions.push_back(e);
+  }
+}
+inline void program::encode(inst i, position pos)
+{
+  markPos(code.size(), pos);
+  code.push_back(i);
+}
+inline size_t program::size() const
+{ return code.size(); }
+inline position program::getPos(const inst *i) const
+{ return getPos(i - &code[0]); }
+inline size_t program::codeBytes() const
+{ return code.size()*sizeof(inst); }
+inline size_t program::posBytes() const
+{ return positions.size()*sizeof(posEntry); }
+#ifdef THREADED_DISPATCH
+inline void program::thread(const void *const *handlers)
+{
+  for (code_t::iterator p = code.begin(); p != code.end(); ++p)
+    p->handler = handlers[p->op];
+  isThreaded = true;
+}
+inline bool program::threaded() const
+{ return isThreaded; }
+#endif
 inline inst& program::operator[](size_t n)
 { return code[n]; }
 inline program::label& program::label::operator++()
@@ -52,8 +52,8 @@ psfile::psfile(const string& filename, bool pdfformat)
     reportError("Cannot write to "+filename);
 }
 
-static const char *inconsistent="inconsistent colorspaces";
-static const char *rectangular="matrix is not rectangular";
+const char *inconsistent="inconsistent colorspaces";
+const char *rectangular="matrix is not rectangular";
   
 void psfile::writefromRGB(unsigned char r, unsigned char g, unsigned char b, 
                           ColorSpace colorspace, size_t ncomponents) 
@@ -30,6 +30,11 @@ inline void BoundingBox(std::ostream& s, const bbox& box)
   s << "%%HiResBoundingBox: " << std::setprecision(9) << box << newl;
 }
 
+void checkColorSpace(ColorSpace colorspace);
+
+extern const char *inconsistent;
+extern const char *rectangular;
+
 // An ASCII85Encode filter.
 class encode85 {
   ostream *out;
@@ -120,8 +125,8 @@ public:
     count=0;
   }
   
-  void outImage(bool antialias, size_t width, size_t height,
-                size_t ncomponents);
+  virtual void outImage(bool antialias, size_t width, size_t height,
+                        size_t ncomponents);
   
   void endImage(bool antialias, size_t width, size_t height,
                 size_t ncomponents) {
@@ -148,8 +153,8 @@ public:
     camp::BoundingBox(*out,box);
   }
   
-  void prologue(const bbox& box);
-  void epilogue();
+  virtual void prologue(const bbox& box);
+  virtual void epilogue();
   void header(bool eps);
 
   void close();
@@ -184,7 +189,7 @@ public:
   }
   
   void setcolor(const pen& p, const string& begin, const string& end);
-  void setopacity(const pen& p);
+  virtual void setopacity(const pen& p);
 
   virtual void setpen(pen p);
   
@@ -295,7 +300,8 @@ public:
   
   void vertexpen(vm::array *pi, int j, ColorSpace colorspace);
   
-  void imageheader(size_t width, size_t height, ColorSpace colorspace);
+  virtual void imageheader(size_t width, size_t height,
+                           ColorSpace colorspace);
   
   void image(const vm::array& a, const vm::array& p, bool antialias);
   void image(const vm::array& a, bool antialias);
@@ -326,7 +332,7 @@ public:
     if(pdf) *out << " 1 0 0 1 " << newl;
     write(z);
     if(pdf) *out << " cm" << newl;
-    *out << " translate" << newl;
+    else *out << " translate" << newl;
   }
 
   // Multiply on a transform to the transformation matrix.
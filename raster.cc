@@ -0,0 +1,337 @@
+/*****
+ * raster.cc
+ *
+ * Write rendered RGB images directly as PNG, PPM, or TGA files.
+ *****/
+
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+#include <zlib.h>
+
+#include "raster.h"
+#include "errormsg.h"
+#include "settings.h"
+
+namespace camp {
+
+using settings::verbose;
+
+void finishRaster();
+
+namespace {
+
+// An image to be written.
+struct rasterJob : public gc {
+  string name;
+  string format;
+  unsigned char *data;
+  size_t width,height;
+  bool antialias;
+  bool ok;
+
+  rasterJob(const string& name, const string& format, unsigned char *data,
+            size_t width, size_t height, bool antialias)
+    : name(name), format(format), data(data), width(width), height(height),
+      antialias(antialias), ok(true) {}
+};
+
+// Returns the image flipped to run from the top row down, with each 2x2
+// block of pixels averaged if antialias is set, updating width and height.
+unsigned char *topdown(const unsigned char *data, size_t& width,
+                       size_t& height, bool antialias)
+{
+  size_t w=width, h=height;
+  if(antialias) {
+    w=std::max(width/2,(size_t) 1);
+    h=std::max(height/2,(size_t) 1);
+  }
+  size_t stride=3*width;
+  unsigned char *out=new unsigned char[3*w*h];
+
+  for(size_t j=0; j < h; ++j) {
+    unsigned char *o=out+3*w*j;
+    if(antialias && width > 1 && height > 1) {
+      const unsigned char *a=data+stride*(height-2-2*j);
+      const unsigned char *b=a+stride;
+      for(size_t i=0; i < w; ++i, a += 6, b += 6)
+        for(size_t k=0; k < 3; ++k)
+          *(o++)=(a[k]+a[k+3]+b[k]+b[k+3]+2)/4;
+    } else {
+      const unsigned char *a=data+stride*(height-1-j);
+      std::copy(a,a+3*w,o);
+    }
+  }
+  width=w;
+  height=h;
+  return out;
+}
+
+void put32(std::ostream& out, uLong n)
+{
+  out.put((char) (n >> 24));
+  out.put((char) (n >> 16));
+  out.put((char) (n >> 8));
+  out.put((char) n);
+}
+
+void chunk(std::ostream& out, const char *type, const unsigned char *data,
+           size_t size)
+{
+  put32(out,size);
+  out.write(type,4);
+  if(size) out.write((const char *) data,size);
+  uLong crc=crc32(0L,Z_NULL,0);
+  crc=crc32(crc,(const Bytef *) type,4);
+  if(size) crc=crc32(crc,data,size);
+  put32(out,crc);
+}
+
+// The Paeth predictor of the PNG specification.
+inline unsigned char paeth(int a, int b, int c)
+{
+  int p=a+b-c;
+  int pa=abs(p-a), pb=abs(p-b), pc=abs(p-c);
+  return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+bool writePNG(std::ostream& out, const unsigned char *a, size_t width,
+              size_t height)
+{
+  static const char signature[]={'\211','P','N','G','\r','\n','\032','\n'};
+  out.write(signature,8);
+
+  unsigned char header[13];
+  for(size_t i=0; i < 4; ++i) {
+    header[i]=(unsigned char) (width >> (24-8*i));
+    header[4+i]=(unsigned char) (height >> (24-8*i));
+  }
+  header[8]=8;  // Bit depth
+  header[9]=2;  // RGB
+  header[10]=0; // Deflate
+  header[11]=0; // Adaptive filtering
+  header[12]=0; // No interlace
+  chunk(out,"IHDR",header,13);
+
+  // Each row is filtered with whichever of the filters gives the smallest
+  // sum of absolute differences, as suggested by the PNG specification.
+  size_t stride=3*width;
+  size_t rowsize=stride+1;
+  size_t size=rowsize*height;
+  unsigned char *filtered=new unsigned char[size];
+  unsigned char *trial=new unsigned char[5*stride];
+  for(size_t j=0; j < height; ++j) {
+    const unsigned char *row=a+stride*j;
+    const unsigned char *up=j > 0 ? row-stride : NULL;
+    size_t best=0;
+    unsigned long bestsum=~0UL;
+    for(size_t f=0; f < 5; ++f) {
+      unsigned char *t=trial+stride*f;
+      unsigned long sum=0;
+      for(size_t i=0; i < stride; ++i) {
+        int x=row[i];
+        int l=i >= 3 ? row[i-3] : 0;
+        int u=up ? up[i] : 0;
+        int ul=(up && i >= 3) ? up[i-3] : 0;
+        unsigned char v;
+        switch(f) {
+          case 0: v=x; break;
+          case 1: v=x-l; break;
+          case 2: v=x-u; break;
+          case 3: v=x-(l+u)/2; break;
+          default: v=x-paeth(l,u,ul); break;
+        }
+        t[i]=v;
+        sum += v < 128 ? v : 256-v;
+      }
+      if(sum < bestsum) {
+        bestsum=sum;
+        best=f;
+      }
+    }
+    unsigned char *o=filtered+rowsize*j;
+    o[0]=(unsigned char) best;
+    std::copy(trial+stride*best,trial+stride*(best+1),o+1);
+  }
+  delete[] trial;
+
+  uLongf compressedSize=compressBound(size);
+  Bytef *compressed=new Bytef[compressedSize];
+  bool ok=compress(compressed,&compressedSize,filtered,size) == Z_OK;
+  delete[] filtered;
+  if(ok) {
+    chunk(out,"IDAT",compressed,compressedSize);
+    chunk(out,"IEND",NULL,0);
+  }
+  delete[] compressed;
+  return ok;
+}
+
+void writePPM(std::ostream& out, const unsigned char *a, size_t width,
+              size_t height)
+{
+  out << "P6\n" << width << " " << height << "\n255\n";
+  out.write((const char *) a,3*width*height);
+}
+
+void writeTGA(std::ostream& out, const unsigned char *a, size_t width,
+              size_t height)
+{
+  unsigned char header[18]={0};
+  header[2]=2; // Uncompressed true color
+  header[12]=(unsigned char) width;
+  header[13]=(unsigned char) (width >> 8);
+  header[14]=(unsigned char) height;
+  header[15]=(unsigned char) (height >> 8);
+  header[16]=24;
+  header[17]=0x20; // Top row first
+  out.write((const char *) header,18);
+
+  size_t n=3*width*height;
+  for(size_t i=0; i < n; i += 3) {
+    out.put(a[i+2]);
+    out.put(a[i+1]);
+    out.put(a[i]);
+  }
+}
+
+void writeJob(rasterJob *job)
+{
+  size_t width=job->width, height=job->height;
+  unsigned char *a=topdown(job->data,width,height,job->antialias);
+  delete[] job->data;
+  job->data=NULL;
+
+  std::ofstream out(job->name.c_str(),std::ios::binary);
+  if(out) {
+    if(job->format == "png")
+      job->ok=writePNG(out,a,width,height);
+    else if(job->format == "ppm")
+      writePPM(out,a,width,height);
+    else
+      writeTGA(out,a,width,height);
+    out.close();
+  }
+  job->ok=job->ok && out;
+  delete[] a;
+}
+
+// Reports the outcome of the jobs, all of them before any error.
+void report(const mem::vector<rasterJob *>& jobs)
+{
+  string failed;
+  for(size_t i=0; i < jobs.size(); ++i) {
+    rasterJob *job=jobs[i];
+    if(!job->ok)
+      failed += (failed.empty() ? "" : ", ")+job->name;
+    else if(verbose > 0)
+      cout << "Wrote " << job->name << endl;
+  }
+  if(!failed.empty())
+    reportError("Cannot write "+failed);
+}
+
+void report(rasterJob *job)
+{
+  report(mem::vector<rasterJob *>(1,job));
+}
+
+#ifdef HAVE_PTHREAD
+// The image being written in the background, and those written but not
+// yet reported.  The renderer may run in its own thread, so access is
+// serialized by lock.
+rasterJob *pending=NULL;
+mem::vector<rasterJob *> completed;
+pthread_t writer;
+pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
+
+// Waits for the background job, if any, to complete, with lock held.
+void join()
+{
+  if(pending) {
+    pthread_join(writer,NULL);
+    completed.push_back(pending);
+    pending=NULL;
+  }
+}
+
+// Returns the jobs to report, with lock held.
+mem::vector<rasterJob *> takeCompleted()
+{
+  mem::vector<rasterJob *> jobs;
+  jobs.swap(completed);
+  return jobs;
+}
+
+void *writeInBackground(void *job)
+{
+  writeJob((rasterJob *) job);
+  return NULL;
+}
+
+// A fallback for exits that bypass main, such as an exit from asy code.
+void finishAtExit()
+{
+  try {
+    finishRaster();
+  } catch(handled_error) {
+  }
+}
+#endif
+
+}
+
+bool rasterformat(const string& format)
+{
+  return format == "png" || format == "ppm" || format == "tga";
+}
+
+void waitRaster()
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&lock);
+  join();
+  pthread_mutex_unlock(&lock);
+#endif
+}
+
+void finishRaster()
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&lock);
+  join();
+  mem::vector<rasterJob *> jobs=takeCompleted();
+  pthread_mutex_unlock(&lock);
+  report(jobs);
+#endif
+}
+
+void writeRaster(const string& name, const string& format,
+                 unsigned char *data, size_t width, size_t height,
+                 bool antialias, bool background)
+{
+  rasterJob *job=new rasterJob(name,format,data,width,height,antialias);
+  if(verbose > 1)
+    cout << "Writing " << name << " directly" << endl;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&lock);
+  join();
+  mem::vector<rasterJob *> previous=takeCompleted();
+  static bool registered=false;
+  if(background && !registered) {
+    registered=true;
+    atexit(finishAtExit);
+  }
+  bool started=background &&
+    pthread_create(&writer,NULL,writeInBackground,job) == 0;
+  if(started) pending=job;
+  pthread_mutex_unlock(&lock);
+  report(previous);
+  if(started) return;
+#endif
+  writeJob(job);
+  report(job);
+}
+
+}
@@ -0,0 +1,37 @@
+/*****
+ * raster.h
+ *
+ * Write rendered RGB images directly as PNG, PPM, or TGA files.
+ *****/
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "common.h"
+
+namespace camp {
+
+// Formats that writeRaster can produce.
+bool rasterformat(const string& format);
+
+// Writes the RGB image data, stored from the bottom row up as read back from
+// OpenGL, to the file name in the given format.  If antialias is set, each
+// 2x2 block of pixels is averaged into one.  The file is written in the
+// background, if possible; data is then owned, and eventually deleted, by the
+// writer.  Otherwise it is deleted before returning.
+void writeRaster(const string& name, const string& format,
+                 unsigned char *data, size_t width, size_t height,
+                 bool antialias, bool background=true);
+
+// Waits until any file being written in the background is complete, leaving
+// any failure to be reported by the next call to finishRaster.
+void waitRaster();
+
+// Waits as waitRaster does, then reports the outcome of the files written in
+// the background since the last report.  This is done at each shipout and
+// before main computes the exit status.
+void finishRaster();
+
+}
+
+#endif
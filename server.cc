@@ -0,0 +1,316 @@
+/*****
+ * server.cc
+ *
+ * A resident process that runs asy jobs sent over a UNIX socket.
+ *****/
+
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "server.h"
+#include "settings.h"
+#include "errormsg.h"
+#include "interact.h"
+#include "process.h"
+#include "util.h"
+
+extern char **environ;
+
+namespace camp {
+
+using settings::getSetting;
+using settings::verbose;
+
+namespace {
+
+// A connection carries the standard streams of the client, then its current
+// directory, arguments, and environment, each sent as a count of strings
+// followed by the strings, and finally, from the server, the wait status of
+// the job.
+
+bool writeAll(int fd, const void *buf, size_t n)
+{
+  const char *p=(const char *) buf;
+  while(n > 0) {
+    ssize_t w=write(fd,p,n);
+    if(w < 0) {
+      if(errno == EINTR) continue;
+      return false;
+    }
+    p += w;
+    n -= w;
+  }
+  return true;
+}
+
+bool readAll(int fd, void *buf, size_t n)
+{
+  char *p=(char *) buf;
+  while(n > 0) {
+    ssize_t r=read(fd,p,n);
+    if(r < 0 && errno == EINTR) continue;
+    if(r <= 0) return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+bool writeStrings(int fd, size_t count, char **s)
+{
+  uint32_t n=count;
+  if(!writeAll(fd,&n,sizeof(n))) return false;
+  for(size_t i=0; i < count; ++i) {
+    uint32_t size=strlen(s[i]);
+    if(!writeAll(fd,&size,sizeof(size)) || !writeAll(fd,s[i],size))
+      return false;
+  }
+  return true;
+}
+
+// Returns the null-terminated array of strings read, or NULL on failure.
+char **readStrings(int fd, int& count)
+{
+  uint32_t n;
+  if(!readAll(fd,&n,sizeof(n))) return NULL;
+  char **s=new char*[n+1];
+  for(uint32_t i=0; i < n; ++i) {
+    uint32_t size;
+    if(!readAll(fd,&size,sizeof(size))) return NULL;
+    s[i]=new char[size+1];
+    if(!readAll(fd,s[i],size)) return NULL;
+    s[i][size]=0;
+  }
+  s[n]=NULL;
+  count=n;
+  return s;
+}
+
+const int nstreams=3;
+
+bool sendStreams(int fd)
+{
+  int fds[nstreams]={STDIN_FILENO,STDOUT_FILENO,STDERR_FILENO};
+  char byte=0;
+  struct iovec iov;
+  iov.iov_base=&byte;
+  iov.iov_len=1;
+
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control,0,sizeof(control));
+  struct msghdr msg;
+  memset(&msg,0,sizeof(msg));
+  msg.msg_iov=&iov;
+  msg.msg_iovlen=1;
+  msg.msg_control=control;
+  msg.msg_controllen=sizeof(control);
+
+  struct cmsghdr *cmsg=CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level=SOL_SOCKET;
+  cmsg->cmsg_type=SCM_RIGHTS;
+  cmsg->cmsg_len=CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg),fds,sizeof(fds));
+
+  return sendmsg(fd,&msg,0) == 1;
+}
+
+// Replaces the standard streams with those of the client.
+bool receiveStreams(int fd)
+{
+  int fds[nstreams];
+  char byte;
+  struct iovec iov;
+  iov.iov_base=&byte;
+  iov.iov_len=1;
+
+  char control[CMSG_SPACE(sizeof(fds))];
+  struct msghdr msg;
+  memset(&msg,0,sizeof(msg));
+  msg.msg_iov=&iov;
+  msg.msg_iovlen=1;
+  msg.msg_control=control;
+  msg.msg_controllen=sizeof(control);
+
+  if(recvmsg(fd,&msg,0) != 1) return false;
+  struct cmsghdr *cmsg=CMSG_FIRSTHDR(&msg);
+  if(!cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+     cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+    return false;
+  memcpy(fds,CMSG_DATA(cmsg),sizeof(fds));
+
+  for(int i=0; i < nstreams; ++i) {
+    dup2(fds[i],i);
+    close(fds[i]);
+  }
+  return true;
+}
+
+void setEnvironment(char **env)
+{
+  mem::vector<string> names;
+  for(char **p=environ; *p; ++p) {
+    string s=*p;
+    names.push_back(s.substr(0,s.find('=')));
+  }
+  for(size_t i=0; i < names.size(); ++i)
+    unsetenv(names[i].c_str());
+  for(char **p=env; *p; ++p)
+    putenv(*p);
+}
+
+int connectTo(const string& name, bool listen)
+{
+  struct sockaddr_un addr;
+  if(name.size() >= sizeof(addr.sun_path))
+    reportError("Socket name too long: "+name);
+  memset(&addr,0,sizeof(addr));
+  addr.sun_family=AF_UNIX;
+  strcpy(addr.sun_path,name.c_str());
+
+  // Replace a stale socket, but never any other kind of file.
+  struct stat buf;
+  if(listen && lstat(name.c_str(),&buf) == 0) {
+    if(!S_ISSOCK(buf.st_mode))
+      reportError(name+" exists and is not a socket");
+    unlink(name.c_str());
+  }
+
+  int fd=socket(AF_UNIX,SOCK_STREAM,0);
+  if(fd < 0)
+    reportError("Cannot create socket");
+
+  if(listen) {
+    // Only the owner may submit jobs.
+    mode_t mask=umask(077);
+    bool ok=bind(fd,(struct sockaddr *) &addr,sizeof(addr)) == 0 &&
+      ::listen(fd,SOMAXCONN) == 0;
+    umask(mask);
+    if(!ok)
+      reportError("Cannot listen on "+name);
+  } else if(connect(fd,(struct sockaddr *) &addr,sizeof(addr)) != 0)
+    reportError("Cannot connect to server "+name);
+
+  return fd;
+}
+
+// Reaps finished jobs as soon as they exit.
+void reap(int)
+{
+  int saved=errno;
+  while(waitpid(-1,NULL,WNOHANG) > 0);
+  errno=saved;
+}
+
+// Runs a job in a child that returns to main with the state of the client,
+// reports its wait status, and exits.
+void job(int fd, int& argc, char **&argv)
+{
+  int dirc,envc;
+  char **dir,**env;
+  if(!receiveStreams(fd) || !(dir=readStrings(fd,dirc)) || dirc != 1 ||
+     !(argv=readStrings(fd,argc)) || !(env=readStrings(fd,envc)))
+    _exit(1);
+
+  if(chdir(dir[0]) != 0) {
+    cerr << "Cannot change to directory " << dir[0] << endl;
+    _exit(1);
+  }
+  setEnvironment(env);
+
+  int pid=fork();
+  if(pid == 0) {
+    close(fd);
+    startpath=NULL;
+    interact::interactive=false;
+    try {
+      settings::setOptions(argc,argv);
+    } catch(handled_error) {
+      em.statusError();
+    }
+    return;
+  }
+
+  int status=1 << 8;
+  if(pid > 0)
+    while(waitpid(pid,&status,0) < 0 && errno == EINTR);
+  writeAll(fd,&status,sizeof(status));
+  _exit(0);
+}
+
+}
+
+void serve(int& argc, char **&argv)
+{
+  string name=getSetting<string>("server");
+  int fd=connectTo(name,true);
+
+  mem::vector<string> modules;
+  string preload=getSetting<string>("preload");
+  for(size_t pos=0; pos < preload.size();) {
+    size_t end=preload.find_first_of(", ",pos);
+    if(end == string::npos) end=preload.size();
+    if(end > pos) modules.push_back(preload.substr(pos,end-pos));
+    pos=end+1;
+  }
+  preloadModules(modules);
+  if(em.errors())
+    reportError("Cannot preload modules");
+  em.clear();
+
+  if(verbose > 0)
+    cout << "Serving on " << name << endl;
+
+  Signal(SIGCHLD,reap);
+  for(;;) {
+    int c=accept(fd,NULL,NULL);
+    if(c < 0) continue;
+
+    cout.flush(); // Flush stdout to avoid duplicate output.
+    cerr.flush();
+    int pid=fork();
+    if(pid == 0) {
+      // The job waits for its own children.
+      Signal(SIGCHLD,SIG_DFL);
+      close(fd);
+      job(c,argc,argv);
+      return;
+    }
+    if(pid < 0)
+      cerr << "Cannot fork process" << endl;
+    close(c);
+  }
+}
+
+int client(int argc, char **argv)
+{
+  string name=getSetting<string>("connect");
+  int fd=connectTo(name,false);
+
+  char *dir=getPath();
+  size_t envc=0;
+  while(environ[envc]) ++envc;
+
+  int status;
+  if(!sendStreams(fd) || !writeStrings(fd,1,&dir) ||
+     !writeStrings(fd,argc,argv) || !writeStrings(fd,envc,environ) ||
+     !readAll(fd,&status,sizeof(status)))
+    reportError("Lost connection to server "+name);
+  close(fd);
+
+  if(WIFSIGNALED(status)) {
+    Signal(WTERMSIG(status),SIG_DFL);
+    raise(WTERMSIG(status));
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+}
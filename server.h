@@ -0,0 +1,27 @@
+/*****
+ * server.h
+ *
+ * A resident process that runs asy jobs sent over a UNIX socket.
+ *****/
+
+#ifndef SERVER_H
+#define SERVER_H
+
+namespace camp {
+
+// Listens on the socket named by the server setting, after translating
+// plain and the modules named by the preload setting.  Each job is run in a
+// child forked from the server, so that it starts with these translations;
+// serve() returns in that child, with argc, argv, the standard streams, the
+// current directory, the environment, and the settings of the client, which
+// then proceeds as a normal run would.  The server itself never returns.
+void serve(int& argc, char **&argv);
+
+// Sends this invocation to the server listening on the socket named by the
+// connect setting, passing along the standard streams, and returns the exit
+// status of the job.
+int client(int argc, char **argv);
+
+}
+
+#endif
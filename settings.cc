@@ -226,6 +226,9 @@ Int verbose;
 
 // Conserve memory at the expense of speed.
 bool compact;
+
+// Rewrite translated code into superinstructions.
+bool optimize=true;
   
 // Colorspace conversion flags (stored in global variables for efficiency). 
 bool gray;
@@ -700,9 +703,14 @@ struct alignSetting : public argumentSetting {
 struct stringArraySetting : public itemSetting {
   stringArraySetting(string name, array *defaultValue)
     : itemSetting(name, 0, "", "",
-                  types::stringArray(), (item) defaultValue) {}
+                  types::stringArray(), (item) defaultValue) {reset();}
 
   bool getOption() {return true;}
+
+  // The array may be modified, so each reset restores a copy of the default.
+  void reset() {
+    value=(item) vm::get<array *>(defaultValue)->copyToDepth(1);
+  }
 };
 
 struct engineSetting : public argumentSetting {
@@ -1139,6 +1147,16 @@ void initSettings() {
     initialize=false;
   }
 
+  // The settings module is built only once, since translated code, such as
+  // a cached plain module, refers directly to the values of its settings.
+  // Later calls restore the default values in place.
+  if(settingsModule) {
+    for(optionsMap_t::iterator opt=optionsMap.begin();
+        opt != optionsMap.end(); ++opt)
+      opt->second->reset();
+    return;
+  }
+
   settingsModule=new types::dummyRecord(symbol::trans("settings"));
   
 // Default mouse bindings
@@ -1253,8 +1271,15 @@ void initSettings() {
   addOption(new incrementOption("novv", 0,"", &verbose,-2));
   
   addOption(new boolSetting("keep", 'k', "Keep intermediate files"));
+  addOption(new IntSetting("jobs", 'j', "n",
+                           "Process input files with n parallel workers",1));
   addOption(new boolSetting("keepaux", 0,
                             "Keep intermediate LaTeX .aux files"));
+  addOption(new boolSetting("labelcache", 0,
+                            "Cache label dimensions across runs", false));
+  addOption(new IntSetting("texpool", 0, "n",
+                           "Number of TeX processes used to measure labels",
+                           1));
   addOption(new engineSetting("tex", 0, "engine",
                               "latex|pdflatex|xelatex|lualatex|tex|pdftex|luatex|context|none",
                               "latex"));
@@ -1276,6 +1301,9 @@ void initSettings() {
   addOption(new boolSetting("parseonly", 'p', "Parse file"));
   addOption(new boolSetting("translate", 's',
                             "Show translated virtual machine code"));
+  addOption(new boolrefSetting("optimize", 0,
+                               "Optimize virtual machine code", &optimize,
+                               true));
   addOption(new boolSetting("tabcompletion", 0,
                             "Interactive prompt auto-completion", true));
   addOption(new boolSetting("listvariables", 'l',
@@ -1329,6 +1357,12 @@ void initSettings() {
                             "Wait for child processes to finish before exiting"));
   addOption(new IntSetting("inpipe", 0, "n","",-1));
   addOption(new IntSetting("outpipe", 0, "n","",-1));
+  addOption(new stringSetting("server", 0, "socket",
+                              "Run jobs sent to socket by asy -connect"));
+  addOption(new stringSetting("preload", 0, "modules",
+                              "Modules the server translates in advance"));
+  addOption(new stringSetting("connect", 0, "socket",
+                              "Run through the server listening on socket"));
   addOption(new boolSetting("exitonEOF", 0, "Exit interactive mode on EOF",
                             true));
                             
@@ -1396,6 +1430,15 @@ void initSettings() {
   addOption(new stringSetting("dvisvgmOptions", 0, "string", ""));
   addOption(new stringSetting("convertOptions", 0, "string", ""));
   addOption(new stringSetting("gsOptions", 0, "string", ""));
+  addOption(new boolSetting("gsresident", 0,
+                            "Keep Ghostscript running between conversions",
+                            false));
+  addOption(new boolSetting("nativepdf", 0,
+                            "Write PDF directly when no PostScript is needed",
+                            true));
+  addOption(new boolSetting("labelfragments", 0,
+                            "Typeset each label once and place it in PDF written directly",
+                            true));
   addOption(new stringSetting("htmlviewerOptions", 0, "string", ""));
   addOption(new stringSetting("psviewerOptions", 0, "string", ""));
   addOption(new stringSetting("pdfviewerOptions", 0, "string", ""));
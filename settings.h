@@ -60,6 +60,7 @@ extern const string suffix;
 extern const string guisuffix;
 extern const string standardprefix;
   
+extern string initdir;
 extern string historyname;
   
 void SetPageDimensions();
@@ -76,6 +77,7 @@ inline T getSetting(string name)
 
 extern Int verbose;
 extern bool compact;
+extern bool optimize;
 extern bool gray;
 extern bool bw;
 extern bool rgb;
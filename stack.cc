@@ -18,6 +18,12 @@
 
 #include "profiler.h"
 
+// The profiler and the stack tracer need to see every instruction, so they
+// always use the switch loop.
+#if defined(THREADED_DISPATCH) && !defined(PROFILE) && !defined(DEBUG_STACK)
+#define THREADED_LOOP
+#endif
+
 #ifdef DEBUG_STACK
 #include <iostream>
 
@@ -37,8 +43,21 @@ const char *dereferenceNullPointer="dereference of null pointer";
 mem::list<bpinfo> bplist;
   
 namespace {
-position curPos = nullPos;
+// The program being run and its current instruction.  The current position
+// is looked up from these only when it is needed.
+program *curCode = 0;
+const inst *curInst = 0;
 const program::label nulllabel;
+
+// Records the current position as the top-level position, if it is in the
+// file being run.  This is done before each call, so builtins such as
+// toplocation see the position of the call.
+inline void markTopPos(position& topPos, const string& fileName)
+{
+  position pos=getPos();
+  if(pos.filename() == fileName)
+    topPos=pos;
+}
 }
 
 inline stack::vars_t base_frame(
@@ -166,10 +185,19 @@ void stack::marshall(size_t args, stack::vars_t vars)
 
 profiler prof;
 
-void dumpProfile() {
-  std::ofstream out("asyprof");
+// Writes the profile in the callgrind format to the file name, and as
+// collapsed stacks for flame graphs to name.folded.
+void dumpProfile(const string& name) {
+  std::ofstream out(name.c_str());
   if (!out.fail())
     prof.dump(out);
+  std::ofstream fold((name+".folded").c_str());
+  if (!fold.fail())
+    prof.folddump(fold);
+  cerr << name << ": " << prof.totalInstructions()
+       << " instructions executed" << (settings::optimize ? "" :
+                                       " (unoptimized)") << endl;
+  prof.summary(cerr);
 }
 #endif
 
@@ -180,6 +208,7 @@ void assessClosure(lambda *body) {
 
   for (program::label l = body->code->begin(); l != body->code->end(); ++l)
     if (l->op == inst::pushclosure ||
+        l->op == inst::savefunc ||
         l->op == inst::pushframe) {
       body->closureReq = lambda::NEEDS_CLOSURE;
       return;
@@ -215,7 +244,7 @@ void stack::run(func *f)
 
 void stack::breakpoint(absyntax::runnable *r) 
 {
-  lastPos=curPos;
+  lastPos=getPos();
   indebugger=true;
   ::run::breakpoint(this,r);
   string s=vm::pop<string>(this);
@@ -225,6 +254,7 @@ void stack::breakpoint(absyntax::runnable *r)
   
 void stack::debug() 
 {
+  position curPos=getPos();
   if(!curPos) return;
   if(indebugger) {em.clear(); return;}
   
@@ -270,18 +300,15 @@ void stack::debug()
 
 void stack::runWithOrWithoutClosure(lambda *l, vars_t vars, vars_t parent)
 {
-  // The size of the frame (when running without closure).
-  size_t frameSize = l->parentIndex;
-
 #ifdef SIMPLE_FRAME
-  // Link to the variables, be they in a closure or on the stack.
+  // Link to the variables, be they in a closure or in the frame arena.
   frame *varlink;
 
 #  define SET_VARLINK assert(vars); varlink = vars;
 #  define VAR(n) ( (varlink)[(n) + frameStart] )
 #  define FRAMEVAR(frame,n) (frame[(n)])
 #else
-  // Link to the variables, be they in a closure or on the stack.
+  // Link to the variables, be they in a closure or in the frame arena.
   mem::vector<item> *varlink=NULL;
 
 #  define SET_VARLINK assert(vars); varlink = &vars->vars
@@ -289,8 +316,51 @@ void stack::runWithOrWithoutClosure(lambda *l, vars_t vars, vars_t parent)
 #  define FRAMEVAR(frame,n) ((*frame)[(n)])
 #endif
 
+#ifdef PROFILE
+  // Keep every call visible to the profiler.
+#  define TAILCALL(f) { f->call(this); return; }
+#else
+  // A tail call to a function compiled to bytecode starts the function
+  // here in place of the running one, so that recursion in tail position
+  // does not grow the C++ stack.  The frame of the running function is
+  // released on the way.
+#  define TAILCALL(f) { func *fn = dynamic_cast<func *>(f); \
+                        if (fn) { \
+                          l = fn->body; vars = 0; parent = fn->closure; \
+                          goto enter; \
+                        } \
+                        f->call(this); return; }
+#endif
+
+#ifndef PROFILE
+ enter:
+#endif
   size_t frameStart = 0;
 
+  // Releases a frame allocated in the arena when the function exits, be it
+  // by a ret instruction or by an exception.
+  struct arenaFrame {
+    frames_t *arena;
+    size_t start;
+    arenaFrame() : arena(0), start(0) {}
+    ~arenaFrame() {
+      if (arena)
+        arena->resize(start);
+    }
+  } release;
+
+  // Restores the program and instruction of the caller when the function
+  // exits.
+  struct runningCode {
+    program *code;
+    const inst *pc;
+    runningCode() : code(curCode), pc(curInst) {}
+    ~runningCode() {
+      curCode = code;
+      curInst = pc;
+    }
+  } caller;
+
   // Set up the closure, if necessary.
   if (vars == 0)
   {
@@ -308,22 +378,19 @@ void stack::runWithOrWithoutClosure(lambda *l, vars_t vars, vars_t parent)
     {
       assert(l->closureReq == lambda::DOESNT_NEED_CLOSURE);
 
-      // Use the stack to store variables.
-      varlink = &theStack;
-
-      // Record where the parameters start on the stack.
-      frameStart = theStack.size() - frameSize;
+      // Nothing can refer to the variables once the function returns, so
+      // allocate them on top of the frame arena.
+      varlink = &frameArena;
+      frameStart = frameArena.size();
+      frameArena.resize(frameStart + l->framesize);
 
-      // Add the parent's closure to the frame.
-      push(parent);
-      ++frameSize;
+      // Move the arguments from the stack and link to the parent's closure.
+      for (size_t i = l->parentIndex; i > 0; --i)
+        frameArena[frameStart + i-1] = pop();
+      frameArena[frameStart + l->parentIndex] = parent;
 
-      size_t newFrameSize = (size_t)l->framesize;
-
-      if (newFrameSize > frameSize) {
-        theStack.resize(frameStart + newFrameSize);
-        frameSize = newFrameSize;
-      }
+      release.arena = &frameArena;
+      release.start = frameStart;
     }
 #endif
   }
@@ -339,14 +406,52 @@ void stack::runWithOrWithoutClosure(lambda *l, vars_t vars, vars_t parent)
   position& topPos=processData().topPos;
   string& fileName=processData().fileName;
 
+  curCode = l->code;
+
   try {
+#ifdef THREADED_LOOP
+    // The address of the code for each instruction, in opcode order.
+    static const void *const handlers[] = {
+#define OPCODE(name,type) &&op_##name,
+#include "opcodes.h"
+#undef OPCODE
+    };
+
+    program *code = l->code;
+    if (!code->threaded())
+      code->thread(handlers);
+
+    // The fast loop does no per-instruction checks for breakpoints, tracing
+    // or interrupts; the interrupt flag is only examined on jumps and
+    // calls.  If debugging is started while a function is running, the
+    // debugger takes over at the next call.
+    if (bplist.empty() && settings::verbose <= 4) {
+      const inst *pc = &*ip;
+
+#define DISPATCH { curInst = pc; goto *pc->handler; }
+#define OP(name) op_##name: { const inst &i = *pc; (void) i;
+#define NEXT } ++pc; DISPATCH
+#define JUMP(l) { pc = &*(l); \
+                  if(errorstream::interrupt) throw interrupted(); \
+                  DISPATCH }
+#define CALLING { markTopPos(topPos, fileName); \
+                  if(errorstream::interrupt) throw interrupted(); }
+
+      DISPATCH;
+#include "stackops.h"
+
+#undef CALLING
+#undef JUMP
+#undef NEXT
+#undef OP
+#undef DISPATCH
+    }
+#endif
+
     for (;;) {
       const inst &i = *ip;
-      curPos = i.pos;
-      
-  if(curPos.filename() == fileName)
-    topPos=curPos;
-  
+      curInst = &i;
+
 #ifdef PROFILE
       prof.recordInstruction();
 #endif
@@ -354,11 +459,11 @@ void stack::runWithOrWithoutClosure(lambda *l, vars_t vars, vars_t parent)
 #ifdef DEBUG_STACK
       printInst(cout, ip, l->code->begin());
       cout << "    (";
-			i.pos.printTerse(cout);
+			getPos().printTerse(cout);
 			cout << ")\n";
 #endif
 
-      if(settings::verbose > 4) em.trace(curPos);
+      if(settings::verbose > 4) em.trace(getPos());
       
       if(!bplist.empty()) debug();
       
@@ -366,171 +471,18 @@ void stack::runWithOrWithoutClosure(lambda *l, vars_t vars, vars_t parent)
       
       switch (i.op)
         {
-          case inst::varpush:
-            push(VAR(get<Int>(i)));
-            break;
-
-          case inst::varsave:
-            VAR(get<Int>(i)) = top();
-            break;
-        
-#ifdef COMBO
-          case inst::varpop:
-            VAR(get<Int>(i)) = pop();
-            break;
-#endif
+#define OP(name) case inst::name: {
+#define NEXT } break;
+#define JUMP(l) { ip = (l); continue; }
+#define CALLING markTopPos(topPos, fileName);
 
-          case inst::ret: {
-            if (vars == 0)
-              // Delete the frame from the stack.
-              // TODO: Optimize for common cases.
-              theStack.erase(theStack.begin() + frameStart,
-                             theStack.begin() + frameStart + frameSize);
-            return;
-          }
-
-          case inst::pushframe:
-          {
-            assert(vars);
-            Int size = get<Int>(i);
-            vars=make_pushframe(size, vars);
-
-            SET_VARLINK;
-
-            break;
-          }
-
-          case inst::popframe:
-          {
-            assert(vars);
-            vars=get<frame *>(VAR(0));
-
-            SET_VARLINK;
-
-            break;
-          }
-
-          case inst::pushclosure:
-            assert(vars);
-            push(vars);
-            break; 
-
-          case inst::nop:
-            break;
-
-          case inst::pop:
-            pop();
-            break;
-        
-          case inst::intpush:
-          case inst::constpush:
-            push(i.ref);
-            break;
-        
-          case inst::fieldpush: {
-            vars_t frame = pop<vars_t>();
-            if (!frame)
-              error(dereferenceNullPointer);
-            push(FRAMEVAR(frame, get<Int>(i)));
-            break;
-          }
-        
-          case inst::fieldsave: {
-            vars_t frame = pop<vars_t>();
-            if (!frame)
-              error(dereferenceNullPointer);
-            FRAMEVAR(frame, get<Int>(i)) = top();
-            break;
-          }
-
-#if COMBO
-          case inst::fieldpop: {
-#error NOT REIMPLEMENTED
-            vars_t frame = pop<vars_t>();
-            if (!frame)
-              error(dereferenceNullPointer);
-            FRAMEVAR(get<Int>(i)) = pop();
-            break;
-          }
-#endif
-        
-        
-          case inst::builtin: {
-            bltin func = get<bltin>(i);
-#ifdef PROFILE
-            prof.beginFunction(func);
-#endif
-            func(this);
-#ifdef PROFILE
-            prof.endFunction(func);
-#endif
-            break;
-          }
-
-          case inst::jmp:
-            ip = get<program::label>(i);
-            continue;
-
-          case inst::cjmp:
-            if (pop<bool>()) { ip = get<program::label>(i); continue; }
-            break;
-
-          case inst::njmp:
-            if (!pop<bool>()) { ip = get<program::label>(i); continue; }
-            break;
-
-          case inst::jump_if_not_default:
-            if (!isdefault(pop())) { ip = get<program::label>(i); continue; }
-            break;
-
-#ifdef COMBO
-          case inst::gejmp: {
-            Int y = pop<Int>();
-            Int x = pop<Int>();
-            if (x>=y)
-              { ip = get<program::label>(i); continue; }
-            break;
-          }
+#include "stackops.h"
 
-#if 0
-          case inst::jump_if_func_eq: {
-            callable * b=pop<callable *>();
-            callable * a=pop<callable *>();
-            if (a->compare(b))
-              { ip = get<program::label>(i); continue; }
-            break;
-          }
-
-          case inst::jump_if_func_neq: {
-            callable * b=pop<callable *>();
-            callable * a=pop<callable *>();
-            if (!a->compare(b))
-              { ip = get<program::label>(i); continue; }
-            break;
-          }
-#endif
-#endif
+#undef CALLING
+#undef JUMP
+#undef NEXT
+#undef OP
 
-          case inst::push_default:
-            push(Default);
-            break;
-
-          case inst::popcall: {
-            /* get the function reference off of the stack */
-            callable* f = pop<callable*>();
-            f->call(this);
-            break;
-          }
-
-          case inst::makefunc: {
-            func *f = new func;
-            f->closure = pop<vars_t>();
-            f->body = get<lambda*>(i);
-
-            push((callable*)f);
-            break;
-          }
-        
           default:
             error("Internal VM error: Bad stack operand");
         }
@@ -547,6 +499,7 @@ void stack::runWithOrWithoutClosure(lambda *l, vars_t vars, vars_t parent)
     error("Trying to use uninitialized value.");
   }
 
+#undef TAILCALL
 #undef SET_VARLINK
 #undef VAR
 #undef FRAMEVAR
@@ -638,12 +591,12 @@ void draw(ostream& out, frame* v)
 #endif // DEBUG_STACK
 
 position getPos() {
-  return curPos;
+  return curCode ? curCode->getPos(curInst) : nullPos;
 }
 
 void errornothrow(const char* message)
 {
-  em.error(curPos);
+  em.error(getPos());
   em << message;
   em.sync();
 }
@@ -56,6 +56,12 @@ private:
   typedef mem::vector<item> stack_t;
   stack_t theStack;
 
+  // The variables of functions that do not need a closure.  Frames are
+  // pushed on entry and popped on exit, so they never involve the garbage
+  // collector.
+  typedef mem::vector<item> frames_t;
+  frames_t frameArena;
+
   void draw(ostream& out);
 
   // The initializer functions for imports, indexed by name.
@@ -0,0 +1,172 @@
+/*****
+ * stackops.h
+ *
+ * The bodies of the virtual machine instructions.  This file is included by
+ * stack::runWithOrWithoutClosure once for each dispatch loop, which define:
+ *
+ *   OP(name)  - begin the instruction inst::name, binding it to i
+ *   NEXT      - end the instruction and go on to the next one
+ *   JUMP(l)   - continue execution at the program::label l
+ *   CALLING   - run before control is passed to another function
+ *   TAILCALL(f) - call f in place of the running function and return
+ *****/
+
+OP(varpush)
+  push(VAR(get<Int>(i)));
+NEXT
+
+OP(varsave)
+  VAR(get<Int>(i)) = top();
+NEXT
+
+OP(varpop)
+  VAR(get<Int>(i)) = pop();
+NEXT
+
+OP(ret)
+  // A frame in the arena is released on the way out.
+  return;
+NEXT
+
+OP(pushframe)
+  assert(vars);
+  Int size = get<Int>(i);
+  vars=make_pushframe(size, vars);
+
+  SET_VARLINK;
+NEXT
+
+OP(popframe)
+  assert(vars);
+  vars=get<frame *>(VAR(0));
+
+  SET_VARLINK;
+NEXT
+
+OP(pushclosure)
+  assert(vars);
+  push(vars);
+NEXT
+
+OP(nop)
+NEXT
+
+OP(pop)
+  pop();
+NEXT
+
+OP(intpush)
+  push(i.ref);
+NEXT
+
+OP(constpush)
+  push(i.ref);
+NEXT
+
+OP(fieldpush)
+  vars_t frame = pop<vars_t>();
+  if (!frame)
+    error(dereferenceNullPointer);
+  push(FRAMEVAR(frame, get<Int>(i)));
+NEXT
+
+OP(fieldsave)
+  vars_t frame = pop<vars_t>();
+  if (!frame)
+    error(dereferenceNullPointer);
+  FRAMEVAR(frame, get<Int>(i)) = top();
+NEXT
+
+OP(fieldpop)
+  vars_t frame = pop<vars_t>();
+  if (!frame)
+    error(dereferenceNullPointer);
+  FRAMEVAR(frame, get<Int>(i)) = pop();
+NEXT
+
+OP(builtin)
+  bltin func = get<bltin>(i);
+  CALLING;
+#ifdef PROFILE
+  prof.beginFunction(func);
+#endif
+  func(this);
+#ifdef PROFILE
+  prof.endFunction(func);
+#endif
+NEXT
+
+OP(jmp)
+  JUMP(get<program::label>(i));
+NEXT
+
+OP(cjmp)
+  if (pop<bool>()) JUMP(get<program::label>(i));
+NEXT
+
+OP(njmp)
+  if (!pop<bool>()) JUMP(get<program::label>(i));
+NEXT
+
+OP(jump_if_not_default)
+  if (!isdefault(pop())) JUMP(get<program::label>(i));
+NEXT
+
+#ifdef COMBO
+OP(gejmp)
+  Int y = pop<Int>();
+  Int x = pop<Int>();
+  if (x>=y)
+    JUMP(get<program::label>(i));
+NEXT
+#endif
+
+OP(push_default)
+  push(Default);
+NEXT
+
+OP(popcall)
+  /* get the function reference off of the stack */
+  callable* f = pop<callable*>();
+  CALLING;
+  f->call(this);
+NEXT
+
+OP(tailcall)
+  callable* f = pop<callable*>();
+  CALLING;
+  TAILCALL(f);
+NEXT
+
+OP(makefunc)
+  func *f = new func;
+  f->closure = pop<vars_t>();
+  f->body = get<lambda*>(i);
+
+  push((callable*)f);
+NEXT
+
+OP(varcall)
+  callable* f = get<callable*>(VAR(get<Int>(i)));
+  CALLING;
+  f->call(this);
+NEXT
+
+OP(fieldcall)
+  vars_t frame = pop<vars_t>();
+  if (!frame)
+    error(dereferenceNullPointer);
+  callable* f = get<callable*>(FRAMEVAR(frame, get<Int>(i)));
+  CALLING;
+  f->call(this);
+NEXT
+
+OP(savefunc)
+  assert(vars);
+  funcslot *fs = get<funcslot*>(i);
+  func *f = new func;
+  f->closure = vars;
+  f->body = fs->body;
+
+  VAR(fs->index) = (callable*)f;
+NEXT
@@ -60,6 +60,38 @@ void texfile::miniprologue()
   } else *out << "\\nopagenumbers" << newl;
 }
 
+void texfile::fragmentprologue()
+{
+  texdefines(*out,processData().TeXpreamble,false);
+  // Object streams cannot be read back by pdfdocument.
+  *out << "\\ifx\\pdfobjcompresslevel\\undefined\\else"
+       << "\\pdfobjcompresslevel=0\\fi" << newl
+       << "\\pdfhorigin=0bp" << newl
+       << "\\pdfvorigin=0bp" << newl;
+  if(settings::latex(texengine)) {
+    *out << "\\begin{document}" << newl;
+    latexfontencoding(*out);
+  }
+}
+
+void texfile::beginfragment()
+{
+  // The font and color are set within the box.
+  *out << "\\setbox\\ASYbox=\\hbox{%" << newl;
+  resetpen();
+}
+
+void texfile::endfragment(const string& label)
+{
+  *out << label << "}%" << newl
+       << "\\pdfpagewidth=\\wd\\ASYbox" << newl
+       << "\\pdfpageheight=\\ht\\ASYbox" << newl
+       << "\\advance\\pdfpageheight by\\dp\\ASYbox" << newl
+       << "\\edef\\ASYattr{/ASYdepth (\\the\\dp\\ASYbox)}%" << newl
+       << "\\pdfpageattr\\expandafter{\\ASYattr}%" << newl
+       << "\\shipout\\box\\ASYbox" << newl;
+}
+
 void texfile::prologue()
 {
   if(inlinetex) {
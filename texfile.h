@@ -121,7 +121,7 @@ void dvipsfix(T &out)
 
 template<class T>
 void texdefines(T& out, mem::list<string>& preamble=processData().TeXpreamble,
-                bool pipe=false)
+                bool pipe=false, const string& jobname="texput")
 {
   if(pipe || !settings::getSetting<bool>("inlinetex"))
     texpreamble(out,preamble,pipe);
@@ -131,7 +131,7 @@ void texdefines(T& out, mem::list<string>& preamble=processData().TeXpreamble,
     string name=auxname(settings::outname(),"aux");
     std::ifstream fin(name.c_str());
     if(fin) {
-      std::ofstream fout("texput.aux");
+      std::ofstream fout((jobname+".aux").c_str());
       string s;
       while(getline(fin,s))
         fout << s << endl;
@@ -245,6 +245,13 @@ public:
   
   void miniprologue();
   
+  // Begins a document of labels for pdfTeX, each shipped out on its own
+  // page, cropped to the box of the label, with its depth recorded in the
+  // page attribute /ASYdepth.
+  void fragmentprologue();
+  void beginfragment();
+  void endfragment(const string& label);
+
   void writeshifted(path p, bool newPath=true);
   virtual double hoffset() {return Hoffset;}
   virtual double voffset() {return box.bottom;}
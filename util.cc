@@ -29,6 +29,12 @@
 #include "errormsg.h"
 #include "camperror.h"
 #include "interact.h"
+#include "raster.h"
+
+#ifdef HAVE_POSIX_SPAWNP
+#include <spawn.h>
+extern char **environ;
+#endif
 
 using namespace settings;
 
@@ -225,7 +231,7 @@ char **args(const mem::vector<string>& s, bool quiet)
   for(size_t i=0; i < count; ++i)
     argv[i]=StrdupNoGC(s[i]);
   
-  if(!quiet && settings::verbose > 1) {
+  if(!quiet && settings::verbose > 1 && count > 0) {
     cerr << argv[0];
     for(size_t i=1; i < count; ++i) cerr << " " << argv[i];
     cerr << endl;
@@ -256,22 +262,88 @@ void execError(const char *command, const char *hint, const char *application)
   }
 }
                                                     
-// quiet: 0=none; 1=suppress stdout; 2=suppress stdout+stderr.
-int System(const mem::vector<string> &command, int quiet, bool wait,
-           const char *hint, const char *application, int *ppid)
+#ifdef HAVE_POSIX_SPAWNP
+int spawn(char **argv, int quiet, const char *hint, const char *application,
+          int infd, int outfd, int out_fileno)
 {
-  int status;
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  if(infd >= 0) {
+    posix_spawn_file_actions_adddup2(&actions,infd,STDIN_FILENO);
+    posix_spawn_file_actions_addclose(&actions,infd);
+  }
+  if(outfd >= 0) {
+    posix_spawn_file_actions_adddup2(&actions,outfd,out_fileno);
+    posix_spawn_file_actions_addclose(&actions,outfd);
+  }
+  if(quiet) {
+    posix_spawn_file_actions_addopen(&actions,STDOUT_FILENO,"/dev/null",
+                                     O_WRONLY,0);
+    if(quiet == 2)
+      posix_spawn_file_actions_adddup2(&actions,STDOUT_FILENO,STDERR_FILENO);
+  }
 
-  cout.flush(); // Flush stdout to avoid duplicate output.
-    
-  char **argv=args(command);
+  // The command starts with the default action for the signals that asy may
+  // catch or ignore, and with no signals blocked.  In an interactive session
+  // it is put in its own process group, so that an interrupt typed at the
+  // terminal reaches only asy.
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t signals;
+  sigemptyset(&signals);
+  static const int reset[]={SIGINT,SIGQUIT,SIGHUP,SIGTERM,SIGPIPE,SIGCHLD};
+  for(size_t i=0; i < sizeof(reset)/sizeof(*reset); ++i)
+    sigaddset(&signals,reset[i]);
+  posix_spawnattr_setsigdefault(&attr,&signals);
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attr,&signals);
+  short flags=POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+  if(interact::interactive) {
+    posix_spawnattr_setpgroup(&attr,0);
+    flags |= POSIX_SPAWN_SETPGROUP;
+  }
+  posix_spawnattr_setflags(&attr,flags);
+
+  pid_t pid;
+  int rc=posix_spawnp(&pid,argv[0],&actions,&attr,argv,environ);
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+
+  if(rc != 0) {
+    execError(argv[0],hint,application);
+    return -1;
+  }
+  return pid;
+}
+#else
+int spawn(char **argv, int quiet, const char *hint, const char *application,
+          int infd, int outfd, int out_fileno)
+{
+  // A failure to execute the command is reported through a pipe that exec
+  // closes, so that it is returned as by posix_spawnp.
+  int status[2];
+  if(pipe(status) == -1)
+    camp::reportError("Cannot create pipe");
+  fcntl(status[1],F_SETFD,FD_CLOEXEC);
 
   int pid=fork();
   if(pid == -1)
     camp::reportError("Cannot fork process");
   
   if(pid == 0) {
+    close(status[0]);
     if(interact::interactive) signal(SIGINT,SIG_IGN);
+    if(infd >= 0) {
+      close(STDIN_FILENO);
+      dup2(infd,STDIN_FILENO);
+      close(infd);
+    }
+    if(outfd >= 0) {
+      close(out_fileno);
+      dup2(outfd,out_fileno);
+      close(outfd);
+    }
     if(quiet) {
       static int null=creat("/dev/null",O_WRONLY);
       close(STDOUT_FILENO);
@@ -281,13 +353,46 @@ int System(const mem::vector<string> &command, int quiet, bool wait,
         dup2(null,STDERR_FILENO);
       }
     }
-    if(argv) {
-      execvp(argv[0],argv);
-      execError(argv[0],hint,application);
-      _exit(-1);
-    }
+    execvp(argv[0],argv);
+    int error=errno;
+    if(write(status[1],&error,sizeof(error)) != sizeof(error)) {}
+    _exit(-1);
+  }
+
+  close(status[1]);
+  int error;
+  ssize_t n;
+  while((n=read(status[0],&error,sizeof(error))) < 0 && errno == EINTR);
+  close(status[0]);
+  if(n > 0) {
+    while(waitpid(pid,NULL,0) < 0 && errno == EINTR);
+    execError(argv[0],hint,application);
+    return -1;
+  }
+  return pid;
+}
+#endif
+
+// quiet: 0=none; 1=suppress stdout; 2=suppress stdout+stderr.
+int System(const mem::vector<string> &command, int quiet, bool wait,
+           const char *hint, const char *application, int *ppid)
+{
+  int status;
+
+  // Let the command see any image still being written.
+  camp::waitRaster();
+
+  cout.flush(); // Flush stdout to avoid duplicate output.
+    
+  char **argv=args(command);
+  if(!argv[0]) {
+    delete [] argv;
+    return 0;
   }
 
+  int pid=spawn(argv,quiet,hint,application);
+  if(pid < 0) return -1;
+
   if(ppid) *ppid=pid;
   for(;;) {
     if(waitpid(pid, &status, wait ? 0 : WNOHANG) == -1) {
@@ -81,6 +81,17 @@ void push_command(mem::vector<string>& a, const string& s);
 // by spaces not within matching single quotes.
 char **args(const mem::vector<string> &args, bool quiet=false);
   
+// Starts the command argv, with its standard input and the descriptor
+// out_fileno redirected to infd and outfd, if these are nonnegative, and
+// its standard output (quiet=1) and error (quiet=2) discarded.  Where
+// posix_spawn is available it is used instead of fork, which must copy the
+// page tables of the whole heap.  Returns the process id, or -1 if the
+// command cannot be executed.  (A posix_spawnp that does not report exec
+// failures, unlike that of glibc, instead returns a child that exits with
+// status 127.)
+int spawn(char **argv, int quiet, const char *hint, const char *application,
+          int infd=-1, int outfd=-1, int out_fileno=STDOUT_FILENO);
+
 // Similar to the standard system call except allows interrupts and does
 // not invoke a shell.
 int System(const mem::vector<string> &command, int quiet=0, bool wait=true,